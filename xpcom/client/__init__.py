@@ -40,12 +40,15 @@ import new
 import logging
 import itertools
 from xpcom import xpt, COMException, nsError, logger
+import infocache
 
 # Suck in stuff from _xpcom we use regularly to prevent a module lookup
 from xpcom._xpcom import IID_nsISupports, IID_nsIClassInfo, \
     IID_nsISupportsCString, IID_nsISupportsString, \
     IID_nsISupportsWeakReference, IID_nsIWeakReference, \
-    XPTI_GetInterfaceInfoManager, GetComponentManager, NS_InvokeByIndex
+    XPTI_GetInterfaceInfoManager, GetComponentManager, NS_InvokeByIndex, \
+    NS_InvokeBySignature, NS_GetPropertyBySignature, NS_SetPropertyBySignature, \
+    MakeMethodSignature, MakeMethod
 
 # Attribute names we may be __getattr__'d for, but know we don't want to delegate
 # Could maybe just look for startswith("__") but this may screw things for some objects.
@@ -59,40 +62,38 @@ _int_interfaces = _just_int_interfaces + _just_float_interfaces
 _long_interfaces = _just_long_interfaces + _just_int_interfaces + _just_float_interfaces
 _float_interfaces = _just_float_interfaces + _just_long_interfaces + _just_int_interfaces
 
-method_template = """
-def %s(self, %s):
-    return NS_InvokeByIndex(self._comobj_, %d, (%s, (%s)))
-"""
-def _MakeMethodCode(method):
-    # Build a declaration
+# The description of a method we build methods from, as plain data (so it
+# can live in the infocache):
+#   (name, method_index, ((param_flags, hidden_indicator, type_repr), ...))
+# where type_repr is as returned by xpt.MakeReprForInvoke.
+def _MakeMethodSpec(method):
+    params = tuple([(param.param_flags, param.hidden_indicator, xpt.MakeReprForInvoke(param))
+                    for param in method.params])
+    return method.name, method.method_index, params
+
+# Returns a tuple of (param_flags, arg_names, num_required) for a method
+# spec - the type descriptors for all params, and the names and number of
+# required args the method is called with.
+def _ParseMethodSpec(spec):
+    name, method_index, params = spec
     param_no = 0
-    param_decls = []
     param_flags = []
-    param_names = []
+    arg_names = []
+    num_required = 0
     used_default = 0
-    for param in method.params:
+    for flags, hidden_indicator, type_repr in params:
         param_no = param_no + 1
-        param_name = "Param%d" % (param_no,)
-        param_default = ""
-        if not param.hidden_indicator and param.IsIn() and not param.IsDipper():
+        if not hidden_indicator and XPT_PD_IS_IN(flags) and not XPT_PD_IS_DIPPER(flags):
             # If the param is "inout", provide a useful default for the "in" direction.
-            if param.IsOptional() or param.IsOut() or used_default:
-                param_default = " = None"
+            if XPT_PD_IS_OPTIONAL(flags) or XPT_PD_IS_OUT(flags) or used_default:
                 # Once we have used one once, we must for the rest!
                 used_default = 1
-            param_decls.append(param_name + param_default)
-            param_names.append(param_name)
-
-        type_repr = xpt.MakeReprForInvoke(param)
-        param_flags.append( (param.param_flags,) +  type_repr )
-    sep = ", "
-    param_decls = sep.join(param_decls)
-    if len(param_names)==1: # Damn tuple reprs.
-        param_names = param_names[0] + ","
-    else:
-        param_names = sep.join(param_names)
-    # A couple of extra newlines make them easier to read for debugging :-)
-    return method_template % (method.name, param_decls, method.method_index, tuple(param_flags), param_names)
+            else:
+                num_required = num_required + 1
+            arg_names.append("Param%d" % (param_no,))
+
+        param_flags.append( (flags,) +  type_repr )
+    return tuple(param_flags), tuple(arg_names), num_required
 
 # Keyed by IID, each item is a tuple of (methods, getters, setters)
 interface_cache = {}
@@ -104,77 +105,97 @@ contractid_info_cache = {}
 have_shutdown = 0
 
 def _shutdown():
+    infocache.Save()
     interface_cache.clear()
     interface_method_cache.clear()
     contractid_info_cache.clear()
     global have_shutdown
     have_shutdown = 1
 
-# Fully process the named method, generating method code etc.
-def BuildMethod(method_info, iid):
-    name = method_info.name
+# Fully process the named method.
+# method_spec is as returned by _MakeMethodSpec.
+def BuildMethod(method_spec, iid):
+    name, method_index = method_spec[:2]
     try:
         return interface_method_cache[iid][name]
     except KeyError:
         pass
-    # Generate it.
-    assert not (method_info.IsSetter() or method_info.IsGetter()), "getters and setters should have been weeded out by now"
-    method_code = _MakeMethodCode(method_info)
-    # Build the method - We only build a function object here
-    # - they are bound to each instance as needed.
-    
-##    print "Method Code for %s (%s):" % (name, iid)
-##    print method_code
-    codeObject = compile(method_code, "<XPCOMObject method '%s'>" % (name,), "exec")
-    # Exec the code object
-    tempNameSpace = {}
-    exec codeObject in globals(), tempNameSpace
-    ret = tempNameSpace[name]
+    param_flags, arg_names, num_required = _ParseMethodSpec(method_spec)
+    # We only build an unbound method here - they are bound to each
+    # instance as needed.
+    ret = MakeMethod(name, MakeMethodSignature(iid, method_index, param_flags),
+                     arg_names, num_required)
     if not interface_method_cache.has_key(iid):
         interface_method_cache[iid] = {}
     interface_method_cache[iid][name] = ret
     return ret
 
 from xpcom.xpcom_consts import XPT_MD_GETTER, XPT_MD_SETTER, XPT_MD_NOTXPCOM, XPT_MD_CTOR, XPT_MD_HIDDEN
+from xpcom.xpcom_consts import XPT_PD_IS_IN, XPT_PD_IS_OUT, XPT_PD_IS_DIPPER, XPT_PD_IS_OPTIONAL
 FLAGS_TO_IGNORE = XPT_MD_NOTXPCOM | XPT_MD_CTOR | XPT_MD_HIDDEN
 
+# Walk the interface info, building the plain data BuildInterfaceInfo
+# works from (and the infocache stores):
+#   (method_count, constant_count, methods, getters, setters, constants)
+# methods maps names to method specs (see _MakeMethodSpec), getters and
+# setters map names to (method_index, param_flags), and constants map
+# names to values.
+def _BuildInterfaceEntry(iid):
+    getters = {}
+    setters = {}
+    methods = {}
+    interface = xpt.Interface(iid)
+    for m in interface.methods:
+        flags = m.flags
+        if flags & FLAGS_TO_IGNORE == 0:
+            if flags & (XPT_MD_SETTER | XPT_MD_GETTER):
+                param_flags = tuple(map(lambda x: (x.param_flags,) + xpt.MakeReprForInvoke(x), m.params))
+                if flags & XPT_MD_SETTER:
+                    setters[m.name] = (m.method_index, param_flags)
+                else:
+                    getters[m.name] = (m.method_index, param_flags)
+            else:
+                methods[m.name] = _MakeMethodSpec(m)
+    # Build the constants.
+    constants = {}
+    for c in interface.constants:
+        constants[c.name] = c.value
+    return len(interface.methods), len(interface.constants), \
+           methods, getters, setters, constants
+
 # Pre-process the interface - generate a list of methods, constants etc,
 # but don't actually generate the method code.
 def BuildInterfaceInfo(iid):
     assert not have_shutdown, "Can't build interface info after a shutdown"
     ret = interface_cache.get(iid, None)
     if ret is None:
-        # Build the data for the cache.
-        method_code_blocks = []
+        entry = infocache.Lookup(iid)
+        if entry is None:
+            entry = _BuildInterfaceEntry(iid)
+            infocache.Store(iid, entry)
+        method_infos, property_getters, property_setters, constants = entry[2:]
+        # Properties are stored as compiled signatures, which
+        # _Interface hands straight to the native code.
         getters = {}
         setters = {}
-        method_infos = {}
-        iid_from_name = {}
-        
-        interface = xpt.Interface(iid)
-        for m in interface.methods:
-            flags = m.flags
-            if flags & FLAGS_TO_IGNORE == 0:
-                if flags & XPT_MD_SETTER:
-                    param_flags = map(lambda x: (x.param_flags,) + xpt.MakeReprForInvoke(x), m.params)
-                    setters[m.name] = m.method_index, param_flags
-                elif flags & XPT_MD_GETTER:
-                    param_flags = map(lambda x: (x.param_flags,) + xpt.MakeReprForInvoke(x), m.params)
-                    getters[m.name] = m.method_index, param_flags
-                else:
-                    method_infos[m.name] = m
-
-        # Build the constants.
-        constants = {}
-        for c in interface.constants:
-            constants[c.name] = c.value
+        for props, sigs in ((property_getters, getters), (property_setters, setters)):
+            for name, (method_index, param_flags) in props.iteritems():
+                try:
+                    sigs[name] = MakeMethodSignature(iid, method_index, param_flags)
+                except ValueError, why:
+                    # Types we can't handle at all (eg, jsval)
+                    logger.debug("Ignoring property %s.%s: %s", iid.name, name, why)
         # Build name to iid dictionary.
+        iid_from_name = {}
         for name in itertools.chain(method_infos, getters, setters, constants):
             iid_from_name[name] = iid
         ret = (method_infos, getters, setters, constants, iid_from_name)
         interface_cache[iid] = ret
     return ret
 
+# Identity (hashing and comparison) is delegated to the underlying
+# interface object, which queries for and remembers its canonical
+# nsISupports once.
 class _XPCOMBase:
     def __cmp__(self, other):
         try:
@@ -194,12 +215,14 @@ class _XPCOMBase:
             pass
         return self._comobj_ == other
 
-    def __neq__(self, other):
+    def __ne__(self, other):
         try:
             other = other._comobj_
         except AttributeError:
             pass
         return self._comobj_ != other
+    # The name this was originally (mis)spelt with.
+    __neq__ = __ne__
 
     # See if the object support strings.
     def __str__(self):
@@ -260,6 +283,15 @@ class Component(_XPCOMBase):
         self.__dict__['_object_name_'] = ob_name
         self.QueryInterface(iid)
 
+    # Components created by the framework for returned interfaces (see
+    # MakeDefaultWrapper in PyISupports.cpp) skip __init__ - they are given
+    # the same __dict__, plus '_pending_iid_' for the interface 'ob' is
+    # already known to implement.  We only reflect that interface when the
+    # object is first used.
+    def _resolve_pending_iid_(self):
+        iid = self.__dict__.pop('_pending_iid_')
+        self._add_interface_(self._comobj_, iid)
+
     def _build_all_supported_interfaces_(self):
         # Use nsIClassInfo, but don't do it at object construction to keep perf up.
         # Only pay the penalty when we really need it.
@@ -322,6 +354,8 @@ class Component(_XPCOMBase):
         return data
 
     def QueryInterface(self, iid):
+        if '_pending_iid_' in self.__dict__:
+            self._resolve_pending_iid_()
         if iid in self._interfaces_:
             # We have previously attempted to QI to this interface
             assert iid.name in self._interface_names_, \
@@ -348,20 +382,13 @@ class Component(_XPCOMBase):
 
         # We have successfully QIed to the interface; figure out what this
         # interface does and reflect it on the Python object.
-        iface_info = self._remember_interface_info(iid)
-
-        if iface_info is None:
+        if self._add_interface_(raw_iface, iid) is None:
             # We have tried, but failed, to get this interface info.  Its
             # unlikely to work later either - its probably non-scriptable.
             # That means our component wrappers are useless - so just return a
             # raw nsISupports object with no wrapper.            
             return raw_iface
 
-        method_infos, getters, setters, constants, iid_from_name = iface_info
-        new_interface = _Interface(raw_iface, iid, method_infos,
-                                   getters, setters, constants)
-        self._interfaces_[iid] = new_interface
-        self._interface_names_[iid.name] = new_interface
         # As we 'flatten' objects when possible, a QI on an object just
         # returns ourself - all the methods etc on this interface are
         # available.
@@ -369,9 +396,25 @@ class Component(_XPCOMBase):
 
     queryInterface = QueryInterface # Alternate name.
 
+    # Reflect the interface 'raw_iface' (which must already be for 'iid') on
+    # this object.  Returns the new _Interface, or None if we have no
+    # interface info for it.
+    def _add_interface_(self, raw_iface, iid):
+        iface_info = self._remember_interface_info(iid)
+        if iface_info is None:
+            return None
+        method_infos, getters, setters, constants, iid_from_name = iface_info
+        new_interface = _Interface(raw_iface, iid, method_infos,
+                                   getters, setters, constants)
+        self._interfaces_[iid] = new_interface
+        self._interface_names_[iid.name] = new_interface
+        return new_interface
+
     def __getattr__(self, attr):
         if attr in _special_getattr_names:
             raise AttributeError, attr
+        if '_pending_iid_' in self.__dict__:
+            self._resolve_pending_iid_()
         # First allow the interface name to return the "raw" interface
         interface = self.__dict__['_interface_names_'].get(attr, None)
         if interface is not None:
@@ -406,6 +449,8 @@ class Component(_XPCOMBase):
         raise AttributeError, "XPCOM component '%s' has no attribute '%s'" % (self._object_name_, attr)
         
     def __setattr__(self, attr, val):
+        if '_pending_iid_' in self.__dict__:
+            self._resolve_pending_iid_()
         iid = self._name_to_interface_iid_.get(attr, None)
         # This may be first time trying this interface - get the nsIClassInfo
         if iid is None and not self._tried_classinfo_:
@@ -421,6 +466,8 @@ class Component(_XPCOMBase):
         raise AttributeError, "XPCOM component '%s' has no attribute '%s'" % (self._object_name_, attr)
 
     def _get_classinfo_repr_(self):
+        if '_pending_iid_' in self.__dict__:
+            self._resolve_pending_iid_()
         try:
             if not self._tried_classinfo_:
                 self._build_all_supported_interfaces_()
@@ -448,6 +495,8 @@ class Component(_XPCOMBase):
         return "<XPCOM component '%s' (%s)>" % (self._object_name_,iface_desc)
 
     def __dir__(self):
+        if '_pending_iid_' in self.__dict__:
+            self._resolve_pending_iid_()
         if not self._tried_classinfo_:
             try:
                 self._build_all_supported_interfaces_()
@@ -484,14 +533,9 @@ class _Interface(_XPCOMBase):
         if unbound_method is not None:
             return new.instancemethod(unbound_method, self, self.__class__)
 
-        getters = self.__dict__['_property_getters_']
-        info = getters.get(attr)
-        if info is not None:
-            method_index, param_infos = info
-            if len(param_infos)!=1: # Only expecting a retval
-                raise RuntimeError, "Can't get properties with this many args!"
-            args = ( param_infos, () )
-            return NS_InvokeByIndex(self._comobj_, method_index, args)
+        signature = self.__dict__['_property_getters_'].get(attr)
+        if signature is not None:
+            return NS_GetPropertyBySignature(self._comobj_, signature)
 
         # See if we have a method info waiting to be turned into a method.
         # Do this last as it is a one-off hit.
@@ -511,25 +555,25 @@ class _Interface(_XPCOMBase):
             self.__dict__[attr] = val
             return
         # Start sniffing for what sort of attribute this might be?
-        setters = self.__dict__['_property_setters_']
-        info = setters.get(attr)
-        if info is None:
+        signature = self.__dict__['_property_setters_'].get(attr)
+        if signature is None:
             raise AttributeError, "XPCOM component '%s' can not set attribute '%s'" % (self._object_name_, attr)
-        method_index, param_infos = info
-        if len(param_infos)!=1: # Only expecting a single input val
-            raise RuntimeError, "Can't set properties with this many args!"
-        real_param_infos = ( param_infos, (val,) )
-        return NS_InvokeByIndex(self._comobj_, method_index, real_param_infos)
+        return NS_SetPropertyBySignature(self._comobj_, signature, val)
 
     def __repr__(self):
         return "<XPCOM interface '%s'>" % (self._object_name_,)
 
 
-# Called by the _xpcom C++ framework to wrap interfaces up just
-# before they are returned.
+# Wraps a raw interface up as it is returned.  The _xpcom C++ framework now
+# builds its Components directly (see MakeDefaultWrapper in PyISupports.cpp)
+# but this remains for Python code doing the same.
 def MakeInterfaceResult(ob, iid):
     return Component(ob, iid)
 
+# While MakeInterfaceResult is still this function, the framework builds
+# the Component itself rather than calling it.
+_DefaultMakeInterfaceResult = MakeInterfaceResult
+
 class WeakReference:
     """A weak-reference object.  You construct a weak reference by passing
     any COM object you like.  If the object does not support weak
@@ -0,0 +1,157 @@
+# ***** BEGIN LICENSE BLOCK *****
+# Version: MPL 1.1/GPL 2.0/LGPL 2.1
+#
+# The contents of this file are subject to the Mozilla Public License Version
+# 1.1 (the "License"); you may not use this file except in compliance with
+# the License. You may obtain a copy of the License at
+# http://www.mozilla.org/MPL/
+#
+# Software distributed under the License is distributed on an "AS IS" basis,
+# WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+# for the specific language governing rights and limitations under the
+# License.
+#
+# The Original Code is the Python XPCOM language bindings.
+#
+# The Initial Developer of the Original Code is
+# ActiveState Tool Corp.
+# Portions created by the Initial Developer are Copyright (C) 2000, 2001
+# the Initial Developer. All Rights Reserved.
+#
+# Contributor(s):
+#   Mark Hammond <MarkH@ActiveState.com> (original author)
+#
+# Alternatively, the contents of this file may be used under the terms of
+# either the GNU General Public License Version 2 or later (the "GPL"), or
+# the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+# in which case the provisions of the GPL or the LGPL are applicable instead
+# of those above. If you wish to allow use of your version of this file only
+# under the terms of either the GPL or the LGPL, and not to allow others to
+# use your version of this file under the terms of the MPL, indicate your
+# decision by deleting the provisions above and replace them with the notice
+# and other provisions required by the GPL or the LGPL. If you do not delete
+# the provisions above, a recipient may use your version of this file under
+# the terms of any one of the MPL, the GPL or the LGPL.
+#
+# ***** END LICENSE BLOCK *****
+
+# A persistent cache of the tables BuildInterfaceInfo builds from the
+# interface info, so they needn't be rebuilt on every launch.
+#
+# Set PYXPCOM_INFO_CACHE to the name of the cache file (or call Enable()).
+# The file is read when first needed, and rewritten at shutdown if
+# anything was added.  It is only used by the platform build which wrote
+# it - within a build, an IID identifies one interface, as interfaces must
+# change IID when they change.  As a cheap sanity check, each entry also
+# records the interface's method and constant counts, which are checked
+# before the entry is used.
+#
+# Entries hold only plain data (see BuildInterfaceInfo), so the file is
+# just a marshal'd dict keyed by IID string.
+
+import os
+import marshal
+from xpcom import _xpcom, logger
+
+# Bump this whenever the layout of the entries changes.
+CACHE_VERSION = 1
+
+_filename = os.environ.get("PYXPCOM_INFO_CACHE")
+_entries = None # Keyed by str(iid); None until loaded.
+_build_id = None # The platform build ID, found by _Load.
+_dirty = False
+# If not None, used as the build ID instead of asking nsIXULAppInfo (which
+# plain XPCOM apps, such as the test suite, don't have).
+build_id_override = None
+
+def Enable(filename):
+    """Use (and at shutdown, update) the cache in filename."""
+    global _filename, _entries, _build_id, _dirty
+    _filename = filename
+    _entries = _build_id = None
+    _dirty = False
+
+def _GetBuildID():
+    if build_id_override is not None:
+        return build_id_override
+    from xpcom import components
+    try:
+        app_info = components.classes["@mozilla.org/xre/app-info;1"] \
+                       .getService(components.interfaces.nsIXULAppInfo)
+        return app_info.platformBuildID
+    except (_xpcom.Exception, AttributeError, KeyError):
+        return None
+
+def _Load():
+    global _entries, _build_id
+    # Looking up the build ID may build an interface itself.
+    _entries = {}
+    _build_id = build_id = _GetBuildID()
+    if build_id is None:
+        logger.debug("No platform build ID - not using the interface info cache")
+        return
+    try:
+        f = open(_filename, "rb")
+        try:
+            version, file_build_id, entries = marshal.load(f)
+        finally:
+            f.close()
+    except (IOError, EOFError, ValueError, TypeError), why:
+        logger.debug("Not using the interface info cache '%s': %s", _filename, why)
+        return
+    if version != CACHE_VERSION or file_build_id != build_id:
+        logger.debug("The interface info cache '%s' is out of date", _filename)
+        return
+    entries.update(_entries)
+    _entries = entries
+
+def Lookup(iid):
+    """Return the cached entry for iid, or None"""
+    if _filename is None:
+        return None
+    if _entries is None:
+        _Load()
+    entry = _entries.get(str(iid))
+    if entry is None:
+        return None
+    try:
+        info = _xpcom.XPTI_GetInterfaceInfoManager().GetInfoForIID(iid)
+        if entry[0] == info.GetMethodCount() and entry[1] == info.GetConstantCount():
+            return entry
+    except _xpcom.Exception:
+        pass
+    logger.debug("Discarding the stale interface info cache entry for %s", iid)
+    Store(iid, None)
+    return None
+
+def Store(iid, entry):
+    global _dirty
+    if _filename is None:
+        return
+    if _entries is None:
+        _Load()
+    if entry is None:
+        _entries.pop(str(iid), None)
+    else:
+        _entries[str(iid)] = entry
+    _dirty = True
+
+def Save():
+    """Write the cache file, if anything has changed."""
+    global _dirty
+    if _filename is None or not _dirty or _build_id is None:
+        return
+    # Write to a temp file first so no-one sees a partial file.
+    temp_name = _filename + ".tmp"
+    try:
+        f = open(temp_name, "wb")
+        try:
+            marshal.dump((CACHE_VERSION, _build_id, _entries), f)
+        finally:
+            f.close()
+        if os.name == "nt" and os.path.exists(_filename):
+            os.remove(_filename)
+        os.rename(temp_name, _filename)
+        _dirty = False
+    except (IOError, OSError, ValueError), why:
+        logger.warning("Failed to write the interface info cache '%s': %s", _filename, why)
@@ -204,12 +204,10 @@ class _Classes(_ComponentCollection):
     def _build_dict(self):
         ret = {}
         enum = registrar.enumerateContractIDs()
-        while enum.hasMoreElements():
-            # Call the Python-specific FetchBlock, to keep the loop in C.
-            items = enum.fetchBlock(2000, _xpcom.IID_nsISupportsCString)
-            for item in items:
-                name = str(item.data)
-                ret[name] = _Class(name)
+        # The iterator fetches in blocks, keeping the loop in C.
+        for item in enum.iterate(_xpcom.IID_nsISupportsCString):
+            name = str(item.data)
+            ret[name] = _Class(name)
         return ret
 
 classes = _Classes()
@@ -227,6 +225,7 @@ def _on_shutdown():
     # for historical reasons we call these manually.
     xpcom.client._shutdown()
     xpcom.server._shutdown()
+    _xpcom._ShutdownCaches()
 
 # import xpcom.shutdown late as it depends on us!
 import shutdown
@@ -56,3 +56,11 @@ class SimpleEnumerator:
     def getNext(self):
         self._index = self._index + 1
         return self._data[self._index-1]
+
+    # Not part of nsISimpleEnumerator - the gateway uses this to fetch our
+    # elements in blocks, so native callers don't need to call into Python
+    # for every element.
+    def fetchBlock(self, count):
+        ret = self._data[self._index:self._index+count]
+        self._index = self._index + len(ret)
+        return ret
@@ -169,8 +169,7 @@ class ModuleLoader:
                             getService(components.interfaces.nsIProperties)
         extensionDirs = []
         enum = directorySvc.get("XREExtDL", components.interfaces.nsISimpleEnumerator)
-        while enum.hasMoreElements():
-            nsifile = enum.getNext().QueryInterface(components.interfaces.nsIFile)
+        for nsifile in enum.iterate(components.interfaces.nsIFile):
             path = nsifile.path
             if path not in extensionDirs:
                 extensionDirs.append(path)
@@ -180,8 +179,7 @@ class ModuleLoader:
         try:
             enum = directorySvc.get("PyxpcomExtDirList",
                                     components.interfaces.nsISimpleEnumerator)
-            while enum.hasMoreElements():
-                nsifile = enum.getNext().QueryInterface(components.interfaces.nsIFile)
+            for nsifile in enum.iterate(components.interfaces.nsIFile):
                 path = nsifile.path
                 if path not in extensionDirs:
                     extensionDirs.append(path)
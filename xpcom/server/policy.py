@@ -59,6 +59,14 @@ VARIANT_STRING_TYPES = xpcom_consts.VTYPE_CHAR, xpcom_consts.VTYPE_CHAR_STR, xpc
 VARIANT_UNICODE_TYPES = xpcom_consts.VTYPE_WCHAR, xpcom_consts.VTYPE_DOMSTRING, xpcom_consts.VTYPE_WSTRING_SIZE_IS, \
                         xpcom_consts.VTYPE_ASTRING 
 
+# Kinds of entries in a native dispatch table - see _GetDispatchTable_.
+# These must match the DISPATCH_* values in PyGStub.cpp
+DISPATCH_CALL = 0     # getattr(obj, name)(*params)
+DISPATCH_GET_ATTR = 1 # getattr(obj, name)
+DISPATCH_SET_ATTR = 2 # setattr(obj, name, params[0])
+
+_dispatch_tables_ = {} # Indexed by (class, iid)
+
 _supports_primitives_map_ = {} # Filled on first use.
 _function_interfaces_ = None # Filled on first use
 
@@ -148,12 +156,45 @@ class DefaultClassInfo:
     def getHelperForLanguage(self, language):
         return None # Not sure what to do here.
 
+def _BuildDispatchTable(klass, iid):
+    # Work out once what _CallMethod_ would do for each method of the
+    # interface.  Methods the class doesn't define are left as None, so
+    # they still go via _CallMethod_ (which reports the error, or handles
+    # [function] interfaces and attributes set on the instance).
+    interface_info = XPTI_GetInterfaceInfoManager().GetInfoForIID(iid)
+    table = []
+    for index in range(interface_info.GetMethodCount()):
+        flags, name = interface_info.GetMethodInfo(index)[:2]
+        entry = None
+        if XPT_MD_IS_GETTER(flags):
+            if hasattr(klass, "get_" + name):
+                entry = DISPATCH_CALL, intern("get_" + name)
+            else:
+                entry = DISPATCH_GET_ATTR, intern(name)
+        elif XPT_MD_IS_SETTER(flags):
+            if hasattr(klass, "set_" + name):
+                entry = DISPATCH_CALL, intern("set_" + name)
+            else:
+                entry = DISPATCH_SET_ATTR, intern(name)
+        elif hasattr(klass, name):
+            entry = DISPATCH_CALL, intern(name)
+        table.append(entry)
+    return tuple(table)
+
 class DefaultPolicy:
     def __init__(self, instance, iid):
         self._obj_ = instance
         self._nominated_interfaces_ = ni = _GetNominatedInterfaces(instance)
         self._iid_ = iid
         self._is_function_ = None # looked up lazily in _CallMethod_
+        # If true, calls to methods with only simple [in] params are queued
+        # and delivered via _CallMethodBatch_ - see _CallMethodBatch_.
+        self._com_batch_calls_ = getattr(instance, "_com_batch_calls_", False)
+        # nsIVariant params are normally converted to their values by the
+        # gateway itself, without calling _MakeInterfaceParam_.  A policy
+        # which overrides _MakeInterfaceParam_ gets to see them instead.
+        self._com_native_variants_ = \
+            self.__class__._MakeInterfaceParam_.im_func is DefaultPolicy._MakeInterfaceParam_.im_func
         if ni is None:
             raise ValueError, "The object '%r' can not be used as a COM object" % (instance,)
         # This is really only a check for the user - the same thing is
@@ -224,7 +265,7 @@ class DefaultPolicy:
             if iid is None:
                 iid = self._interface_info_.GetIIDForParam(method_index, param_index)
                 self._interface_iid_map_[(method_index, param_index)] = iid
-        # handle nsIVariant
+        # handle nsIVariant - only used when _com_native_variants_ is off.
         if iid == IID_nsIVariant:
             interface = interface.QueryInterface(iid)
             dt = interface.dataType
@@ -299,6 +340,37 @@ class DefaultPolicy:
         # A regular method.
         return 0, func(*params)
 
+    # Called by the gateway before its first call.  For objects whose class
+    # sets _com_dispatch_table_, return (object, table) where the table
+    # maps each method index to how _CallMethod_ would make the call (see
+    # DISPATCH_*), so the gateway can call the object directly.  The
+    # class (and not the instance) decides between get_/set_ methods and
+    # plain attributes.  Return None to have all calls go via _CallMethod_.
+    def _GetDispatchTable_(self):
+        klass = self._obj_.__class__
+        if not getattr(klass, "_com_dispatch_table_", False):
+            return None
+        # A subclass overriding _CallMethod_ must see every call.
+        if self._CallMethod_.im_func is not DefaultPolicy._CallMethod_.im_func:
+            return None
+        key = klass, self._iid_
+        table = _dispatch_tables_.get(key)
+        if table is None:
+            table = _dispatch_tables_[key] = _BuildDispatchTable(klass, self._iid_)
+        return self._obj_, table
+
+    # Called instead of _CallMethod_ for objects which set _com_batch_calls_.
+    # 'calls' is a list of (index, info, params) tuples, in the order the
+    # calls were made.  The caller has already been told the calls
+    # succeeded, so results are ignored and errors can only be reported.
+    def _CallMethodBatch_(self, com_object, calls):
+        for index, info, params in calls:
+            try:
+                self._CallMethod_(com_object, index, info, params)
+            except:
+                self._CallMethodException_(com_object, index, info, params,
+                                           sys.exc_info())
+
     def _doHandleException(self, func_name, exc_info):
         exc_val = exc_info[1]
         is_server_exception = isinstance(exc_val, ServerException)
@@ -385,5 +457,6 @@ class SupportsPrimitive:
 
 def _shutdown():
     class_info_cache.clear()
+    _dispatch_tables_.clear()
     global _function_interfaces_
     del _function_interfaces_
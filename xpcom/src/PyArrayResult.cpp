@@ -0,0 +1,252 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Python XPCOM language bindings.
+ *
+ * The Initial Developer of the Original Code is
+ * ActiveState Tool Corp.
+ * Portions created by the Initial Developer are Copyright (C) 2000
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Mark Hammond <MarkH@ActiveState.com> (original author)
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+// PyArrayResult.cpp -- numeric arrays returned without unpacking
+//
+// This code is part of the XPCOM extensions for Python.
+//
+// Normally a numeric [array] result is unpacked into a list, with an
+// object per element.  When enabled (see SetBufferArrayResults), the
+// array is instead handed to one of these objects, which takes over the
+// memory the callee allocated and exposes it via the buffer interface
+// (for array.array, numpy.frombuffer, memoryview etc) as well as being a
+// read-only sequence.
+
+#include "PyXPCOM_std.h"
+
+static bool g_bBufferArrayResults = false;
+
+bool PyXPCOM_SetBufferArrayResults(bool bEnable)
+{
+	bool bOld = g_bBufferArrayResults;
+	g_bBufferArrayResults = bEnable;
+	return bOld;
+}
+
+// The buffer format for each array type we can hold, or NULL.
+static const char *FormatForArrayType(XPTTypeDescriptorTags array_type)
+{
+	switch (array_type) {
+		case TD_INT8: return "b";
+		case TD_INT16: return "h";
+		case TD_INT32: return "i";
+		case TD_INT64: return "q";
+		case TD_UINT8: return "B";
+		case TD_UINT16: return "H";
+		case TD_UINT32: return "I";
+		case TD_UINT64: return "Q";
+		case TD_FLOAT: return "f";
+		case TD_DOUBLE: return "d";
+		case TD_BOOL: return "?";
+		default: return NULL;
+	}
+}
+
+/*static*/ bool
+PyXPCOM_ArrayResult::CanAdopt(XPTTypeDescriptorTags array_type)
+{
+	return g_bBufferArrayResults && FormatForArrayType(array_type) != NULL;
+}
+
+PyXPCOM_ArrayResult::PyXPCOM_ArrayResult(void *data, PRUint32 count,
+                                         PRUint32 element_size,
+                                         XPTTypeDescriptorTags array_type)
+{
+	ob_type = &type;
+	_Py_NewReference(this);
+	m_data = data;
+	m_count = count;
+	m_itemsize = element_size;
+	m_type = array_type;
+}
+
+PyXPCOM_ArrayResult::~PyXPCOM_ArrayResult()
+{
+	if (m_data)
+		nsMemory::Free(m_data);
+}
+
+/*static*/ Py_ssize_t
+PyXPCOM_ArrayResult::PyTypeMethod_length(PyObject *self)
+{
+	return ((PyXPCOM_ArrayResult *)self)->m_count;
+}
+
+/*static*/ PyObject *
+PyXPCOM_ArrayResult::PyTypeMethod_item(PyObject *self, Py_ssize_t index)
+{
+	PyXPCOM_ArrayResult *me = (PyXPCOM_ArrayResult *)self;
+	if (index < 0 || index >= (Py_ssize_t)me->m_count) {
+		PyErr_SetString(PyExc_IndexError, "array index out of range");
+		return NULL;
+	}
+	PRUint8 *p = (PRUint8 *)me->m_data + index * me->m_itemsize;
+	switch (me->m_type) {
+		case TD_INT8: return PyInt_FromLong(*(PRInt8 *)p);
+		case TD_INT16: return PyInt_FromLong(*(PRInt16 *)p);
+		case TD_INT32: return PyInt_FromLong(*(PRInt32 *)p);
+		case TD_INT64: return PyLong_FromLongLong(*(PRInt64 *)p);
+		case TD_UINT8: return PyInt_FromLong(*(PRUint8 *)p);
+		case TD_UINT16: return PyInt_FromLong(*(PRUint16 *)p);
+		case TD_UINT32: return PyInt_FromLong(*(PRUint32 *)p);
+		case TD_UINT64: return PyLong_FromUnsignedLongLong(*(PRUint64 *)p);
+		case TD_FLOAT: return PyFloat_FromDouble(*(float *)p);
+		case TD_DOUBLE: return PyFloat_FromDouble(*(double *)p);
+		case TD_BOOL: return PyBool_FromLong(*(bool *)p);
+		default:
+			PyErr_SetString(PyExc_RuntimeError, "Invalid array type");
+			return NULL;
+	}
+}
+
+// The old style buffer interface - a single read-only segment.
+/*static*/ Py_ssize_t
+PyXPCOM_ArrayResult::PyTypeMethod_getreadbuffer(PyObject *self, Py_ssize_t segment, void **ptr)
+{
+	PyXPCOM_ArrayResult *me = (PyXPCOM_ArrayResult *)self;
+	if (segment != 0) {
+		PyErr_SetString(PyExc_SystemError, "accessing non-existent array segment");
+		return -1;
+	}
+	*ptr = me->m_data;
+	return me->m_count * me->m_itemsize;
+}
+
+/*static*/ Py_ssize_t
+PyXPCOM_ArrayResult::PyTypeMethod_getsegcount(PyObject *self, Py_ssize_t *lenp)
+{
+	PyXPCOM_ArrayResult *me = (PyXPCOM_ArrayResult *)self;
+	if (lenp)
+		*lenp = me->m_count * me->m_itemsize;
+	return 1;
+}
+
+// The new style buffer interface, which also describes the elements.
+/*static*/ int
+PyXPCOM_ArrayResult::PyTypeMethod_getbuffer(PyObject *self, Py_buffer *view, int flags)
+{
+	PyXPCOM_ArrayResult *me = (PyXPCOM_ArrayResult *)self;
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "XPCOM array results are read-only");
+		return -1;
+	}
+	view->buf = me->m_data;
+	view->obj = self;
+	Py_INCREF(self);
+	view->len = me->m_count * me->m_itemsize;
+	view->readonly = 1;
+	view->itemsize = me->m_itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)FormatForArrayType(me->m_type) : NULL;
+	view->ndim = 1;
+	me->m_shape = me->m_count;
+	view->shape = (flags & PyBUF_ND) ? &me->m_shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &view->itemsize : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+/*static*/ PyObject *
+PyXPCOM_ArrayResult::PyTypeMethod_getattr(PyObject *self, char *name)
+{
+	PyXPCOM_ArrayResult *me = (PyXPCOM_ArrayResult *)self;
+	if (strcmp(name, "typecode")==0)
+		return PyString_FromString(FormatForArrayType(me->m_type));
+	if (strcmp(name, "itemsize")==0)
+		return PyInt_FromLong(me->m_itemsize);
+	return PyErr_Format(PyExc_AttributeError,
+	                    "XPCOM array results have no attribute '%s'", name);
+}
+
+/* static */ PyObject *
+PyXPCOM_ArrayResult::PyTypeMethod_repr(PyObject *self)
+{
+	PyXPCOM_ArrayResult *me = (PyXPCOM_ArrayResult *)self;
+	char buf[128];
+	sprintf(buf, "<XPCOM array result ('%s', %u items) at %p>",
+	        FormatForArrayType(me->m_type), me->m_count, (void *)self);
+	return PyString_FromString(buf);
+}
+
+/*static*/ void
+PyXPCOM_ArrayResult::PyTypeMethod_dealloc(PyObject *ob)
+{
+	delete (PyXPCOM_ArrayResult *)ob;
+}
+
+static PySequenceMethods PyXPCOM_ArrayResult_sequence = {
+	PyXPCOM_ArrayResult::PyTypeMethod_length,       /* sq_length */
+	0,                                              /* sq_concat */
+	0,                                              /* sq_repeat */
+	PyXPCOM_ArrayResult::PyTypeMethod_item,         /* sq_item */
+};
+
+static PyBufferProcs PyXPCOM_ArrayResult_buffer = {
+	PyXPCOM_ArrayResult::PyTypeMethod_getreadbuffer, /* bf_getreadbuffer */
+	0,                                              /* bf_getwritebuffer */
+	PyXPCOM_ArrayResult::PyTypeMethod_getsegcount,  /* bf_getsegcount */
+	0,                                              /* bf_getcharbuffer */
+	PyXPCOM_ArrayResult::PyTypeMethod_getbuffer,    /* bf_getbuffer */
+	0,                                              /* bf_releasebuffer */
+};
+
+// @object PyXPCOM_ArrayResult|A numeric array returned from an XPCOM
+// method, as a read-only sequence which supports the buffer interface.
+PyTypeObject PyXPCOM_ArrayResult::type =
+{
+	PyObject_HEAD_INIT(&PyType_Type)
+	0,
+	"ArrayResult",
+	sizeof(PyXPCOM_ArrayResult),
+	0,
+	PyTypeMethod_dealloc,                           /* tp_dealloc */
+	0,                                              /* tp_print */
+	PyTypeMethod_getattr,                           /* tp_getattr */
+	0,                                              /* tp_setattr */
+	0,                                              /* tp_compare */
+	PyTypeMethod_repr,                              /* tp_repr */
+	0,                                              /* tp_as_number */
+	&PyXPCOM_ArrayResult_sequence,                  /* tp_as_sequence */
+	0,                                              /* tp_as_mapping */
+	0,                                              /* tp_hash */
+	0,                                              /* tp_call */
+	0,                                              /* tp_str */
+	0,                                              /* tp_getattro */
+	0,                                              /* tp_setattro */
+	&PyXPCOM_ArrayResult_buffer,                    /* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /* tp_flags */
+};
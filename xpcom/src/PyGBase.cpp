@@ -76,6 +76,7 @@ PRInt32 _PyXPCOM_GetGatewayCount(void)
 
 extern PyG_Base *MakePyG_nsIModule(PyObject *);
 extern PyG_Base *MakePyG_nsIInputStream(PyObject *instance);
+extern PyG_Base *MakePyG_nsISimpleEnumerator(PyObject *instance);
 
 static char *PyXPCOM_szDefaultGatewayAttributeName = "_com_instance_default_gateway_";
 static PyG_Base *GetDefaultGateway(PyObject *instance);
@@ -94,6 +95,8 @@ PyG_Base::CreateNew(PyObject *pPyInstance, const nsIID &iid, void **ppResult)
 		ret = MakePyG_nsIModule(pPyInstance);
 	else if (iid.Equals(NS_GET_IID(nsIInputStream)))
 		ret = MakePyG_nsIInputStream(pPyInstance);
+	else if (iid.Equals(NS_GET_IID(nsISimpleEnumerator)))
+		ret = MakePyG_nsISimpleEnumerator(pPyInstance);
 	else
 		ret = new PyXPCOM_XPTStub(pPyInstance, iid);
 	if (ret==nullptr)
@@ -159,6 +162,16 @@ PyG_Base::PyG_Base(PyObject *instance, const nsIID &iid)
 #endif // DEBUG_LIFETIMES
 	Py_XINCREF(instance); // instance should never be NULL - but what's an X between friends!
 
+	// We are always created with the GIL held.
+	m_bNativeVariants = false;
+	PyObject *obNativeVariants = PyObject_GetAttrString(instance, "_com_native_variants_");
+	if (obNativeVariants == NULL)
+		PyErr_Clear();
+	else if (PyObject_IsTrue(obNativeVariants) == 1)
+		m_bNativeVariants = true;
+	Py_XDECREF(obNativeVariants);
+	PyErr_Clear();
+
 #ifdef DEBUG_FULL
 	LogF("PyGatewayBase: created %s", m_pPyObject ? m_pPyObject->ob_type->tp_name : "<NULL>");
 #endif
@@ -243,7 +256,7 @@ PyG_Base::~PyG_Base()
 	if (m_pWeakRef) {
 		// Need to ensure some other thread isn't doing a QueryReferent on
 		// our weak reference at the same time
-		CEnterLeaveXPCOMFramework _celf;
+		CEnterLeaveObjectLock _celo(this);
 		PyXPCOM_GatewayWeakReference *p = (PyXPCOM_GatewayWeakReference *)(nsISupports *)m_pWeakRef;
 		p->m_pBase = nullptr;
 		m_pWeakRef = nullptr;
@@ -255,22 +268,23 @@ NS_IMPL_ADDREF(PyG_Base)
 MozExternalRefCountType
 PyG_Base::Release(void)
 {
-	nsrefcnt cnt;
-	{ 
+	// No lock needed to drop a reference - only the last one must
+	// coordinate with QueryReferent on our weak reference, which will
+	// refuse to resurrect us (see AddRefIfAlive).  Nobody can create a
+	// weak reference once the count is zero, so m_pWeakRef is stable.
+	nsrefcnt cnt = (nsrefcnt) PR_ATOMIC_DECREMENT((PRInt32*)&mRefCnt);
+	if ( cnt == 0 && m_pWeakRef ) {
 		// Temp scope for lock. Ensures some other thread isn't doing a
 		// QueryReferent on our weak reference at the same time.
-		CEnterLeaveXPCOMFramework _celf;
-		cnt = (nsrefcnt) PR_ATOMIC_DECREMENT((PRInt32*)&mRefCnt);
-		if ( cnt == 0 && m_pWeakRef ) {
-			// We must null out the WeakReference now, otherwise
-			// another thread may come along and try to use it, i.e.
-			// between the time we release the lock and before we
-			// delete the object (which == ka-BOOM!). See Komodo bug
-			// http://bugs.activestate.com/show_bug.cgi?id=88165
-			PyXPCOM_GatewayWeakReference *p = (PyXPCOM_GatewayWeakReference *)(nsISupports *)m_pWeakRef;
-			p->m_pBase = nullptr;
-			m_pWeakRef = nullptr;
-		}
+		CEnterLeaveObjectLock _celo(this);
+		// We must null out the WeakReference now, otherwise
+		// another thread may come along and try to use it, i.e.
+		// between the time we release the lock and before we
+		// delete the object (which == ka-BOOM!). See Komodo bug
+		// http://bugs.activestate.com/show_bug.cgi?id=88165
+		PyXPCOM_GatewayWeakReference *p = (PyXPCOM_GatewayWeakReference *)(nsISupports *)m_pWeakRef;
+		p->m_pBase = nullptr;
+		m_pWeakRef = nullptr;
 	}
 #ifdef NS_BUILD_REFCNT_LOGGING
 	if (m_pBaseObject == NULL)
@@ -281,6 +295,24 @@ PyG_Base::Release(void)
 	return cnt;
 }
 
+// Add a reference for our weak reference's QueryReferent, which holds
+// our object lock.  If the count was zero, Release() has dropped our last
+// reference and is waiting on that lock to detach the weak reference
+// before deleting us - so back the reference out again and fail.
+bool
+PyG_Base::AddRefIfAlive(void)
+{
+	nsrefcnt cnt = (nsrefcnt) PR_ATOMIC_INCREMENT((PRInt32*)&mRefCnt);
+	if (cnt == 1) {
+		PR_ATOMIC_DECREMENT((PRInt32*)&mRefCnt);
+		return false;
+	}
+#ifdef NS_BUILD_REFCNT_LOGGING
+	if (m_pBaseObject == NULL)
+		NS_LOG_ADDREF(this, cnt, refcntLogRepr, sizeof(*this));
+#endif
+	return true;
+}
 
 // Get the correct interface pointer for this object given the IID.
 void *PyG_Base::ThisAsIID( const nsIID &iid )
@@ -292,7 +324,20 @@ void *PyG_Base::ThisAsIID( const nsIID &iid )
 		return (nsISupportsWeakReference *)this;
 	if (iid.Equals(NS_GET_IID(nsIInternalPython))) 
 		return (nsISupports *)(nsIInternalPython *)this;
-	return NULL;
+
+	// Check for an existing stub that implements this interface, to make
+	// QIing to the same interface return the same stub.  This makes the
+	// objects easier to use from python (no need to keep a reference to
+	// the wrapped object just to find it again).
+	// The stubs are all held by the base object, which may be any kind
+	// of gateway, and need no lock to look up.
+	PyG_Base *base = this;
+	if (m_pBaseObject) {
+		base = m_pBaseObject;
+		if (iid.Equals(base->m_iid))
+			return base->ThisAsIID(iid);
+	}
+	return base->m_stubs.Lookup(iid);
 }
 
 // Call back into Python, passing a Python instance, and get back
@@ -357,6 +402,29 @@ done:
 	return ok;
 }
 
+bool
+PyG_Base::IsVariantParam(const nsIID *piid, int methodIndex,
+                         const XPTParamDescriptor *d)
+{
+	if (piid)
+		return piid->Equals(NS_GET_IID(nsIVariant));
+	if (!d || XPT_TDP_TAG(d->type.prefix) != nsXPTType::T_INTERFACE)
+		return false;
+	if (!m_pInterfaceInfo) {
+		nsCOMPtr<nsIInterfaceInfoManager> iim = XPTI_GetInterfaceInfoManager();
+		if (!iim)
+			return false;
+		iim->GetInfoForIID(&m_iid, getter_AddRefs(m_pInterfaceInfo));
+		if (!m_pInterfaceInfo)
+			return false;
+	}
+	nsIID iid;
+	const nsXPTParamInfo *pi = static_cast<const nsXPTParamInfo *>(d);
+	if (NS_FAILED(m_pInterfaceInfo->GetIIDForParamNoAlloc(methodIndex, pi, &iid)))
+		return false;
+	return iid.Equals(NS_GET_IID(nsIVariant));
+}
+
 // Call back into Python, passing a raw nsIInterface object, getting back
 // the object to actually use as the gateway parameter for this interface.
 // For example, it is expected that the policy will wrap the interface
@@ -370,6 +438,9 @@ done:
 // or the IID will be NULL.
 // Worst case, the code should provide a wrapper for the nsiSupports interface,
 // so at least the user can simply QI the object.
+// nsIVariant params are the exception - unless the policy says otherwise
+// (by clearing _com_native_variants_), we pass the variant's value
+// without calling the policy at all.
 PyObject *
 PyG_Base::MakeInterfaceParam(nsISupports *pis, 
 			     const nsIID *piid, 
@@ -387,6 +458,15 @@ PyG_Base::MakeInterfaceParam(nsISupports *pis,
 	// best to provide the useful data.
 	MOZ_ASSERT(((piid != NULL) ^ (d != NULL)),
 	           "No information on the interface available - Python's gunna have a hard time doing much with it!");
+	if (m_bNativeVariants && IsVariantParam(piid, methodIndex, d)) {
+		// The param is declared as an nsIVariant, so no need to QI.
+		PyObject *ret = PyObject_FromVariant(NULL, static_cast<nsIVariant *>(pis));
+		if (ret)
+			return ret;
+		PyXPCOM_LogError("Converting an nsIVariant param for the gateway failed\n");
+		PyErr_Clear();
+		// Let the policy have a go.
+	}
 	PyObject *obIID = NULL;
 	PyObject *obISupports = NULL;
 	PyObject *obParamDesc = NULL;
@@ -534,9 +614,10 @@ PyG_Base::GetWeakReference(nsIWeakReference **ret)
 	}
 	NS_PRECONDITION(ret, "null pointer");
 	if (ret==nullptr) return NS_ERROR_INVALID_POINTER;
+	// Two threads may ask for our first weak reference at once.
+	CEnterLeaveObjectLock _celo(this);
 	if (!m_pWeakRef) {
 		// First query for a weak reference - create it.
-		// XXX - this looks like it needs thread safety!?
 		m_pWeakRef = new PyXPCOM_GatewayWeakReference(this);
 		NS_ABORT_IF_FALSE(m_pWeakRef, "Shouldn't be able to fail creating a weak reference!");
 		if (!m_pWeakRef)
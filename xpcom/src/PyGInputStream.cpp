@@ -49,10 +49,19 @@
 #include "PyXPCOM_std.h"
 #include <nsIInputStream.h>
 
+// The Python object implements the usual nsIInputStream methods.  For
+// ReadSegments(), it may also provide a (non-XPCOM) method
+//   readSegments(count)
+// returning either a single buffer object or a sequence of buffer objects;
+// the writer is then called directly on the memory of those buffers.  If
+// there is no such method, read(count) is used instead.
 class PyG_nsIInputStream : public PyG_Base, public nsIInputStream
 {
 public:
-	PyG_nsIInputStream(PyObject *instance) : PyG_Base(instance, NS_GET_IID(nsIInputStream)) {;}
+	PyG_nsIInputStream(PyObject *instance)
+		: PyG_Base(instance, NS_GET_IID(nsIInputStream)),
+		  m_pending(nullptr), m_pendingIndex(0), m_pendingOffset(0) {;}
+	~PyG_nsIInputStream();
 	PYGATEWAY_BASE_SUPPORT(nsIInputStream, PyG_Base);
 
 	NS_IMETHOD Close(void);
@@ -60,6 +69,21 @@ public:
 	NS_IMETHOD Read(char * buf, PRUint32 count, PRUint32 *_retval);
 	NS_IMETHOD ReadSegments(nsWriteSegmentFun writer, void * closure, PRUint32 count, PRUint32 *_retval);
 	NS_IMETHOD IsNonBlocking(bool *aNonBlocking);
+protected:
+	// Segments returned by Python which a ReadSegments() writer did not
+	// consume.  Python has already handed the data over, so we serve it
+	// before asking for any more.  This is a tuple/list of buffers (as
+	// returned by PySequence_Fast), with the index and offset of the first
+	// unconsumed byte.
+	PyObject *m_pending;
+	Py_ssize_t m_pendingIndex;
+	Py_ssize_t m_pendingOffset;
+	PRUint64 PendingLength(); // Requires the GIL
+	void ClearPending();      // Requires the GIL
+	// As for InvokeNativeViaPolicy, but a missing method is returned as
+	// NS_PYXPCOM_NO_SUCH_METHOD without reporting an error.
+	nsresult InvokeOptional(const char *szMethodName, PyObject **ppResult,
+	                        const char *szFormat, ...);
 };
 
 
@@ -68,10 +92,56 @@ PyG_Base *MakePyG_nsIInputStream(PyObject *instance)
 	return new PyG_nsIInputStream(instance);
 }
 
+PyG_nsIInputStream::~PyG_nsIInputStream()
+{
+	if (m_pending) {
+		CEnterLeavePython _celp;
+		ClearPending();
+	}
+}
+
+PRUint64
+PyG_nsIInputStream::PendingLength()
+{
+	PRUint64 result = 0;
+	if (!m_pending)
+		return 0;
+	for (Py_ssize_t i = m_pendingIndex; i < PySequence_Fast_GET_SIZE(m_pending); ++i) {
+		const void *py_buf;
+		Py_ssize_t py_size;
+		if (PyObject_AsReadBuffer(PySequence_Fast_GET_ITEM(m_pending, i),
+		                          &py_buf, &py_size) == 0)
+			result += py_size;
+		else
+			PyErr_Clear(); // Checked when we were given it
+	}
+	return result - m_pendingOffset;
+}
+
+void
+PyG_nsIInputStream::ClearPending()
+{
+	Py_CLEAR(m_pending);
+	m_pendingIndex = m_pendingOffset = 0;
+}
+
+nsresult
+PyG_nsIInputStream::InvokeOptional(const char *szMethodName,
+                                   PyObject **ppResult,
+                                   const char *szFormat, ...)
+{
+	va_list va;
+	va_start(va, szFormat);
+	nsresult nr = InvokeNativeViaPolicyInternal(szMethodName, ppResult, szFormat, va);
+	va_end(va);
+	return nr;
+}
+
 NS_IMETHODIMP
 PyG_nsIInputStream::Close()
 {
 	CEnterLeavePython _celp;
+	ClearPending();
 	const char *methodName = "close";
 	return InvokeNativeViaPolicy(methodName, NULL);
 }
@@ -88,17 +158,34 @@ PyG_nsIInputStream::Available(PRUint64 *_retval)
 		*_retval = PyInt_AsUnsignedLongLongMask(ret);
 		if (PyErr_Occurred())
 			nr = HandleNativeGatewayError(methodName);
+		else
+			*_retval += PendingLength();
 		Py_XDECREF(ret);
 	}
 	return nr;
 }
 
+// A ReadSegments() writer which copies into the buffer given as the closure.
+static NS_METHOD
+CopySegmentToBuffer(nsIInputStream *aInStream, void *aClosure,
+                    const char *aFromSegment, PRUint32 aToOffset,
+                    PRUint32 aCount, PRUint32 *aWriteCount)
+{
+	memcpy(reinterpret_cast<char *>(aClosure) + aToOffset, aFromSegment, aCount);
+	*aWriteCount = aCount;
+	return NS_OK;
+}
+
 NS_IMETHODIMP
 PyG_nsIInputStream::Read(char * buf, PRUint32 count, PRUint32 *_retval)
 {
 	NS_PRECONDITION(_retval, "null pointer");
 	NS_PRECONDITION(buf, "null pointer");
 	CEnterLeavePython _celp;
+	if (m_pending) {
+		// Finish off what an earlier ReadSegments() left behind first.
+		return ReadSegments(CopySegmentToBuffer, buf, count, _retval);
+	}
 	PyObject *ret;
 	const char *methodName = "read";
 	nsresult nr = InvokeNativeViaPolicy(methodName, &ret, "i", count);
@@ -129,8 +216,82 @@ PyG_nsIInputStream::Read(char * buf, PRUint32 count, PRUint32 *_retval)
 NS_IMETHODIMP
 PyG_nsIInputStream::ReadSegments(nsWriteSegmentFun writer, void * closure, PRUint32 count, PRUint32 *_retval)
 {
-	NS_WARNING("ReadSegments() not implemented!!!");
-	return NS_ERROR_NOT_IMPLEMENTED;
+	NS_PRECONDITION(_retval, "null pointer");
+	NS_PRECONDITION(writer, "null pointer");
+	CEnterLeavePython _celp;
+	*_retval = 0;
+	nsresult nr = NS_OK;
+	const char *methodName = "readSegments";
+	if (!m_pending) {
+		PyObject *ret = nullptr;
+		nr = InvokeOptional(methodName, &ret, "i", count);
+		if (nr == NS_PYXPCOM_NO_SUCH_METHOD) {
+			methodName = "read";
+			nr = InvokeOptional(methodName, &ret, "i", count);
+		}
+		if (NS_FAILED(nr) || nr == NS_PYXPCOM_NO_SUCH_METHOD) {
+			Py_XDECREF(ret);
+			if (nr == NS_PYXPCOM_NO_SUCH_METHOD)
+				PyErr_Format(PyExc_AttributeError, "The object does not have a '%s' function.", methodName);
+			return HandleNativeGatewayError(methodName);
+		}
+		// A single buffer, or a sequence of them.
+		if (PyObject_CheckReadBuffer(ret))
+			m_pending = PyTuple_Pack(1, ret);
+		else
+			m_pending = PySequence_Fast(ret, "nsIInputStream::readSegments() method must return a buffer object or a sequence of them");
+		Py_DECREF(ret);
+		if (!m_pending)
+			return HandleNativeGatewayError(methodName);
+		m_pendingIndex = m_pendingOffset = 0;
+	}
+
+	// Hand the segments to the writer until it (or our count) is done.
+	// We hold a reference to all the buffers, so their memory stays put
+	// while we release the GIL around the writer.
+	PRUint32 total = 0;
+	bool stop = false;
+	while (!stop && total < count &&
+	       m_pendingIndex < PySequence_Fast_GET_SIZE(m_pending)) {
+		const void *py_buf;
+		Py_ssize_t py_size;
+		PyObject *segment = PySequence_Fast_GET_ITEM(m_pending, m_pendingIndex);
+		if (PyObject_AsReadBuffer(segment, &py_buf, &py_size) != 0) {
+			PyErr_Format(PyExc_TypeError, "nsIInputStream::%s() must return buffer objects - not a '%s' object", methodName, segment->ob_type->tp_name);
+			ClearPending();
+			nr = HandleNativeGatewayError(methodName);
+			// Data already given to the writer has been consumed.
+			return total ? NS_OK : nr;
+		}
+		while (m_pendingOffset < py_size && total < count) {
+			Py_ssize_t left = py_size - m_pendingOffset;
+			PRUint32 chunk = count - total;
+			if ((Py_ssize_t)chunk > left)
+				chunk = static_cast<PRUint32>(left);
+			PRUint32 written = 0;
+			nsresult wr;
+			const char *p = reinterpret_cast<const char *>(py_buf) + m_pendingOffset;
+			Py_BEGIN_ALLOW_THREADS;
+			wr = writer(this, closure, p, total, chunk, &written);
+			Py_END_ALLOW_THREADS;
+			// A writer failing just means stop; it isn't our error.
+			if (NS_FAILED(wr) || written == 0) {
+				stop = true;
+				break;
+			}
+			MOZ_ASSERT(written <= chunk, "Writer consumed more than it was given");
+			total += written;
+			m_pendingOffset += written;
+		}
+		if (m_pendingOffset >= py_size) {
+			++m_pendingIndex;
+			m_pendingOffset = 0;
+		}
+	}
+	if (m_pendingIndex >= PySequence_Fast_GET_SIZE(m_pending))
+		ClearPending();
+	*_retval = total;
+	return NS_OK;
 }
 
 NS_IMETHODIMP
@@ -0,0 +1,260 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Python XPCOM language bindings.
+ *
+ * The Initial Developer of the Original Code is
+ * ActiveState Tool Corp.
+ * Portions created by the Initial Developer are Copyright (C) 2000
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Mark Hammond <MarkH@ActiveState.com> (original author)
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+// PyGSimpleEnumerator.cpp
+//
+// This code is part of the XPCOM extensions for Python.
+
+#include "PyXPCOM_std.h"
+#include <nsISimpleEnumerator.h>
+
+// The Python object implements the usual nsISimpleEnumerator methods.  It
+// may also provide a (non-XPCOM) method
+//   fetchBlock(count)
+// returning a sequence of up to count elements - fewer means there are no
+// more.  The gateway then converts the elements a block at a time, and
+// answers HasMoreElements() and GetNext() from its own array without
+// entering Python at all.  If there is no such method, hasMoreElements()
+// and getNext() are called for each element.
+#define ENUM_GATEWAY_BLOCK 512
+
+class PyG_nsISimpleEnumerator : public PyG_Base, public nsISimpleEnumerator
+{
+public:
+	PyG_nsISimpleEnumerator(PyObject *instance)
+		: PyG_Base(instance, NS_GET_IID(nsISimpleEnumerator)),
+		  m_items(nullptr), m_numItems(0), m_pos(0),
+		  m_bNoFetchBlock(false), m_bDone(false) {;}
+	~PyG_nsISimpleEnumerator();
+	PYGATEWAY_BASE_SUPPORT(nsISimpleEnumerator, PyG_Base);
+
+	NS_DECL_NSISIMPLEENUMERATOR
+protected:
+	// The converted elements not yet handed out, m_items[m_pos:m_numItems].
+	// Guarded by our object lock, but only replaced with the GIL held too,
+	// so we never hold the lock while calling Python.
+	nsISupports **m_items;
+	PRUint32 m_numItems;
+	PRUint32 m_pos;
+	bool m_bNoFetchBlock; // Python has no fetchBlock() method.  GIL only.
+	bool m_bDone; // fetchBlock() has said there are no more.
+	// Answer from m_items if we can: *pMore, and if ppNext, the next
+	// element.  Requires the object lock.
+	bool TakeItem(bool *pMore, nsISupports **ppNext);
+	// As for TakeItem, but fetching a new block if necessary.  Sets
+	// *pHandled to false if Python has no fetchBlock().
+	nsresult TakeOrFetchItem(bool *pMore, nsISupports **ppNext, bool *pHandled);
+	void ClearItems();
+	// As for InvokeNativeViaPolicy, but a missing method is returned as
+	// NS_PYXPCOM_NO_SUCH_METHOD without reporting an error.
+	nsresult InvokeOptional(const char *szMethodName, PyObject **ppResult,
+	                        const char *szFormat, ...);
+};
+
+
+PyG_Base *MakePyG_nsISimpleEnumerator(PyObject *instance)
+{
+	return new PyG_nsISimpleEnumerator(instance);
+}
+
+PyG_nsISimpleEnumerator::~PyG_nsISimpleEnumerator()
+{
+	ClearItems();
+}
+
+void
+PyG_nsISimpleEnumerator::ClearItems()
+{
+	for (; m_pos < m_numItems; m_pos++)
+		NS_IF_RELEASE(m_items[m_pos]);
+	moz_free(m_items);
+	m_items = nullptr;
+	m_numItems = m_pos = 0;
+}
+
+nsresult
+PyG_nsISimpleEnumerator::InvokeOptional(const char *szMethodName,
+                                        PyObject **ppResult,
+                                        const char *szFormat, ...)
+{
+	va_list va;
+	va_start(va, szFormat);
+	nsresult nr = InvokeNativeViaPolicyInternal(szMethodName, ppResult, szFormat, va);
+	va_end(va);
+	return nr;
+}
+
+bool
+PyG_nsISimpleEnumerator::TakeItem(bool *pMore, nsISupports **ppNext)
+{
+	if (m_pos < m_numItems) {
+		*pMore = true;
+		if (ppNext) // Hand over our reference.
+			*ppNext = m_items[m_pos++];
+		return true;
+	}
+	if (m_bDone) {
+		*pMore = false;
+		return true;
+	}
+	return false;
+}
+
+nsresult
+PyG_nsISimpleEnumerator::TakeOrFetchItem(bool *pMore, nsISupports **ppNext,
+                                         bool *pHandled)
+{
+	*pHandled = true;
+	{
+		CEnterLeaveObjectLock _celo(this);
+		if (TakeItem(pMore, ppNext))
+			return NS_OK;
+	}
+	CEnterLeavePython _celp;
+	if (m_bNoFetchBlock) {
+		*pHandled = false;
+		return NS_OK;
+	}
+	{
+		// Another thread may have fetched while we waited for the GIL.
+		CEnterLeaveObjectLock _celo(this);
+		if (TakeItem(pMore, ppNext))
+			return NS_OK;
+	}
+	const char *methodName = "fetchBlock";
+	PyObject *ret = nullptr;
+	nsresult nr = InvokeOptional(methodName, &ret, "i", ENUM_GATEWAY_BLOCK);
+	if (nr == NS_PYXPCOM_NO_SUCH_METHOD) {
+		m_bNoFetchBlock = true;
+		*pHandled = false;
+		return NS_OK;
+	}
+	if (NS_FAILED(nr)) {
+		Py_XDECREF(ret);
+		return HandleNativeGatewayError(methodName);
+	}
+	PyObject *seq = PySequence_Fast(ret, "nsISimpleEnumerator::fetchBlock() method must return a sequence");
+	Py_DECREF(ret);
+	if (!seq)
+		return HandleNativeGatewayError(methodName);
+	PRUint32 n = PySequence_Fast_GET_SIZE(seq);
+	nsISupports **items = nullptr;
+	if (n) {
+		items = reinterpret_cast<nsISupports **>(moz_malloc(sizeof(nsISupports *) * n));
+		if (!items) {
+			Py_DECREF(seq);
+			return NS_ERROR_OUT_OF_MEMORY;
+		}
+	}
+	PRUint32 i;
+	for (i = 0; i < n; i++) {
+		items[i] = nullptr;
+		if (!Py_nsISupports::InterfaceFromPyObject(PySequence_Fast_GET_ITEM(seq, i),
+		                                           NS_GET_IID(nsISupports),
+		                                           &items[i], true)) {
+			nr = HandleNativeGatewayError(methodName);
+			break;
+		}
+	}
+	Py_DECREF(seq);
+	if (NS_FAILED(nr)) {
+		while (i--)
+			NS_IF_RELEASE(items[i]);
+		moz_free(items);
+		return nr;
+	}
+	// Only GIL holders replace the array, so the old one is still empty
+	// and there is nothing to release under the lock.
+	CEnterLeaveObjectLock _celo(this);
+	MOZ_ASSERT(m_pos == m_numItems, "Replacing a block with items left");
+	moz_free(m_items);
+	m_items = items;
+	m_numItems = n;
+	m_pos = 0;
+	if (n < ENUM_GATEWAY_BLOCK)
+		m_bDone = true;
+	// We now have an item, or are done.
+	TakeItem(pMore, ppNext);
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyG_nsISimpleEnumerator::HasMoreElements(bool *_retval)
+{
+	NS_PRECONDITION(_retval, "null pointer");
+	bool handled;
+	nsresult nr = TakeOrFetchItem(_retval, nullptr, &handled);
+	if (NS_FAILED(nr) || handled)
+		return nr;
+	CEnterLeavePython _celp;
+	PyObject *ret;
+	const char *methodName = "hasMoreElements";
+	nr = InvokeNativeViaPolicy(methodName, &ret);
+	if (NS_SUCCEEDED(nr)) {
+		int more = PyObject_IsTrue(ret);
+		if (more < 0)
+			nr = HandleNativeGatewayError(methodName);
+		else
+			*_retval = more != 0;
+		Py_DECREF(ret);
+	}
+	return nr;
+}
+
+NS_IMETHODIMP
+PyG_nsISimpleEnumerator::GetNext(nsISupports **_retval)
+{
+	NS_PRECONDITION(_retval, "null pointer");
+	bool more, handled;
+	*_retval = nullptr;
+	nsresult nr = TakeOrFetchItem(&more, _retval, &handled);
+	if (NS_FAILED(nr))
+		return nr;
+	if (handled)
+		return more ? NS_OK : NS_ERROR_FAILURE;
+	CEnterLeavePython _celp;
+	PyObject *ret;
+	const char *methodName = "getNext";
+	nr = InvokeNativeViaPolicy(methodName, &ret);
+	if (NS_SUCCEEDED(nr)) {
+		if (!Py_nsISupports::InterfaceFromPyObject(ret, NS_GET_IID(nsISupports),
+		                                           _retval, true))
+			nr = HandleNativeGatewayError(methodName);
+		Py_DECREF(ret);
+	}
+	return nr;
+}
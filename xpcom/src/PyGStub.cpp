@@ -48,42 +48,324 @@
 
 #include "PyXPCOM_std.h"
 #include <nsIInterfaceInfoManager.h>
+#include "nsThreadUtils.h"
+#include "prlock.h"
+#include "prthread.h"
+
+// Batching of notification style calls.
+//
+// A policy which sets '_com_batch_calls_' has calls to methods taking
+// only simple [in] params queued rather than delivered immediately -
+// the caller gets NS_OK back straight away.  The first call queued
+// posts an event to the calling thread, which hands every call queued
+// up to that point to the policy's _CallMethodBatch_ in one go.
+struct PyXPCOM_PendingCall {
+	PRUint16 methodIndex;
+	const XPTMethodDescriptor *info;
+	nsTArray<nsXPTCMiniVariant> params;
+};
+
+class PyXPCOM_CallBatch {
+public:
+	PyXPCOM_CallBatch() : lock(PR_NewLock()), thread(nullptr) {}
+	~PyXPCOM_CallBatch() {
+		MOZ_ASSERT(calls.IsEmpty(), "Dropping batched calls!");
+		PR_DestroyLock(lock);
+	}
+	PRLock *lock;
+	// The thread the pending calls were made on.
+	PRThread *thread;
+	nsTArray<PyXPCOM_PendingCall> calls;
+};
+
+class PyXPCOM_FlushBatchEvent : public nsRunnable {
+public:
+	PyXPCOM_FlushBatchEvent(PyXPCOM_XPTStub *stub) : mStub(stub) {
+		mStub->AddRef();
+	}
+	~PyXPCOM_FlushBatchEvent() {
+		mStub->Release();
+	}
+	NS_IMETHOD Run() {
+		mStub->FlushBatch();
+		return NS_OK;
+	}
+private:
+	PyXPCOM_XPTStub *mStub;
+};
+
+// A method can be batched if it has nothing to hand back to the caller,
+// and all its params can be copied for delivery later.
+static bool IsBatchableMethod(const XPTMethodDescriptor *info)
+{
+	if (XPT_MD_IS_GETTER(info->flags) || XPT_MD_IS_NOTXPCOM(info->flags))
+		return false;
+	for (int i = 0; i < info->num_args; i++) {
+		const XPTParamDescriptor &pi = info->params[i];
+		if (XPT_PD_IS_OUT(pi.flags) || XPT_PD_IS_RETVAL(pi.flags) ||
+		    XPT_PD_IS_SHARED(pi.flags) || XPT_PD_IS_DIPPER(pi.flags))
+			return false;
+		switch (XPT_TDP_TAG(pi.type.prefix)) {
+		  case nsXPTType::T_I8:
+		  case nsXPTType::T_I16:
+		  case nsXPTType::T_I32:
+		  case nsXPTType::T_I64:
+		  case nsXPTType::T_U8:
+		  case nsXPTType::T_U16:
+		  case nsXPTType::T_U32:
+		  case nsXPTType::T_U64:
+		  case nsXPTType::T_FLOAT:
+		  case nsXPTType::T_DOUBLE:
+		  case nsXPTType::T_BOOL:
+		  case nsXPTType::T_CHAR:
+		  case nsXPTType::T_WCHAR:
+		  case nsXPTType::T_IID:
+		  case nsXPTType::T_CHAR_STR:
+		  case nsXPTType::T_WCHAR_STR:
+		  case nsXPTType::T_INTERFACE:
+		  case nsXPTType::T_INTERFACE_IS:
+		  case nsXPTType::T_DOMSTRING:
+		  case nsXPTType::T_ASTRING:
+		  case nsXPTType::T_CSTRING:
+		  case nsXPTType::T_UTF8STRING:
+			break;
+		  default:
+			// arrays, size_is strings, jsvals etc.
+			return false;
+		}
+	}
+	return true;
+}
+
+static void *CloneBytes(const void *p, size_t size)
+{
+	void *ret = moz_xmalloc(size);
+	memcpy(ret, p, size);
+	return ret;
+}
+
+// Take our own copy of the [in] params of a batchable method.
+static void CopyBatchParams(const XPTMethodDescriptor *info,
+                            const nsXPTCMiniVariant *params,
+                            nsTArray<nsXPTCMiniVariant> &copy)
+{
+	copy.AppendElements(params, info->num_args);
+	for (int i = 0; i < info->num_args; i++) {
+		void *&p = copy[i].val.p;
+		switch (XPT_TDP_TAG(info->params[i].type.prefix)) {
+		  case nsXPTType::T_IID:
+			if (p)
+				p = CloneBytes(p, sizeof(nsIID));
+			break;
+		  case nsXPTType::T_CHAR_STR:
+			if (p)
+				p = CloneBytes(p, strlen((const char *)p) + 1);
+			break;
+		  case nsXPTType::T_WCHAR_STR:
+			if (p) {
+				const char16_t *s = (const char16_t *)p;
+				size_t len = 0;
+				while (s[len])
+					len++;
+				p = CloneBytes(p, (len + 1) * sizeof(char16_t));
+			}
+			break;
+		  case nsXPTType::T_INTERFACE:
+		  case nsXPTType::T_INTERFACE_IS:
+			NS_IF_ADDREF((nsISupports *)p);
+			break;
+		  case nsXPTType::T_DOMSTRING:
+		  case nsXPTType::T_ASTRING:
+			if (p)
+				p = new nsString(*(const nsAString *)p);
+			break;
+		  case nsXPTType::T_CSTRING:
+		  case nsXPTType::T_UTF8STRING:
+			if (p)
+				p = new nsCString(*(const nsACString *)p);
+			break;
+		  default:
+			// arithmetic types are copied by value.
+			break;
+		}
+	}
+}
+
+static void FreeBatchParams(const XPTMethodDescriptor *info,
+                            nsTArray<nsXPTCMiniVariant> &copy)
+{
+	for (int i = 0; i < info->num_args; i++) {
+		void *p = copy[i].val.p;
+		switch (XPT_TDP_TAG(info->params[i].type.prefix)) {
+		  case nsXPTType::T_IID:
+		  case nsXPTType::T_CHAR_STR:
+		  case nsXPTType::T_WCHAR_STR:
+			if (p)
+				moz_free(p);
+			break;
+		  case nsXPTType::T_INTERFACE:
+		  case nsXPTType::T_INTERFACE_IS:
+			NS_IF_RELEASE(*(nsISupports **)&copy[i].val.p);
+			break;
+		  case nsXPTType::T_DOMSTRING:
+		  case nsXPTType::T_ASTRING:
+			delete (nsString *)p;
+			break;
+		  case nsXPTType::T_CSTRING:
+		  case nsXPTType::T_UTF8STRING:
+			delete (nsCString *)p;
+			break;
+		  default:
+			break;
+		}
+	}
+	copy.Clear();
+}
+
+// Marks a slot whose stub has been removed.
+static void * const kDeadStub = reinterpret_cast<void *>(1);
+
+static inline PRUint32 HashIID(const nsIID &iid)
+{
+	PRUint32 m3;
+	memcpy(&m3, iid.m3, sizeof(m3));
+	return iid.m0 ^ (iid.m1 << 16) ^ iid.m2 ^ m3;
+}
+
+PyXPCOM_StubTable::~PyXPCOM_StubTable()
+{
+	delete mSlots;
+}
+
+void *PyXPCOM_StubTable::Lookup(const nsIID &iid)
+{
+	Slots *slots = mSlots;
+	if (!slots)
+		return nullptr;
+	// There is always at least one empty slot, so this terminates.
+	PRUint32 mask = slots->capacity - 1;
+	for (PRUint32 i = HashIID(iid) & mask; ; i = (i + 1) & mask) {
+		void *stub = slots->slot[i].stub;
+		if (!stub)
+			return nullptr;
+		if (stub != kDeadStub && slots->slot[i].iid.Equals(iid))
+			return stub;
+	}
+}
+
+/*static*/ void PyXPCOM_StubTable::Insert(Slots *slots, const nsIID &iid, void *stub)
+{
+	PRUint32 mask = slots->capacity - 1;
+	PRUint32 i = HashIID(iid) & mask;
+	while (slots->slot[i].stub)
+		i = (i + 1) & mask;
+	// The IID must be in place before a reader can see the stub.
+	slots->slot[i].iid = iid;
+	slots->slot[i].stub = stub;
+	slots->used++;
+}
+
+// Reuse the dead slot left by an earlier stub for the IID, if any.  The
+// slot keeps its IID, so this is safe with readers about, and tear-off
+// stubs coming and going don't use up the table.
+/*static*/ bool PyXPCOM_StubTable::Revive(Slots *slots, const nsIID &iid, void *stub)
+{
+	PRUint32 mask = slots->capacity - 1;
+	for (PRUint32 i = HashIID(iid) & mask; slots->slot[i].stub; i = (i + 1) & mask) {
+		if (slots->slot[i].stub == kDeadStub && slots->slot[i].iid.Equals(iid)) {
+			slots->slot[i].stub = stub;
+			return true;
+		}
+	}
+	return false;
+}
+
+void PyXPCOM_StubTable::Add(const nsIID &iid, void *stub)
+{
+	Slots *slots = mSlots;
+	if (slots && Revive(slots, iid, stub))
+		return;
+	// Keep the table at most 3/4 full (counting dead slots).
+	if (!slots || (slots->used + 1) * 4 > slots->capacity * 3) {
+		// Dead slots are carried over, so each IID keeps its slot to be
+		// revived.  The table then only grows with the number of distinct
+		// IIDs, doubling each time, which bounds the arrays we keep.
+		PRUint32 count = slots ? slots->used + 1 : 1;
+		PRUint32 capacity = 8;
+		while (count * 2 > capacity)
+			capacity *= 2;
+		Slots *newSlots = new Slots(capacity, slots);
+		if (slots) {
+			for (PRUint32 i = 0; i < slots->capacity; i++) {
+				void *p = slots->slot[i].stub;
+				if (p)
+					Insert(newSlots, slots->slot[i].iid, p);
+			}
+		}
+		mSlots = newSlots;
+		slots = newSlots;
+	}
+	Insert(slots, iid, stub);
+}
+
+void PyXPCOM_StubTable::Remove(const nsIID &iid, void *stub)
+{
+	// Readers may still be looking at a retired array, so the stub must
+	// go from all of them.
+	for (Slots *slots = mSlots; slots; slots = slots->retired) {
+		PRUint32 mask = slots->capacity - 1;
+		for (PRUint32 i = HashIID(iid) & mask; slots->slot[i].stub; i = (i + 1) & mask) {
+			if (slots->slot[i].stub == stub) {
+				slots->slot[i].stub = kDeadStub;
+				break;
+			}
+		}
+	}
+}
 
 PyXPCOM_XPTStub::PyXPCOM_XPTStub(PyObject *instance, const nsIID &iid)
 	: PyG_Base(instance, iid),
-	  m_pNextObject(nullptr)
+	  m_pBatch(nullptr),
+	  m_bDispatchTableLoaded(false),
+	  m_pDispatchTarget(nullptr),
+	  m_pDispatchTable(nullptr)
 {
 	if (NS_FAILED(InitStub(iid)))
 		NS_ERROR("InitStub must not fail!");
 	MOZ_ASSERT(mXPTCStub);
 
-	{
+	// We are always created with the GIL held.
+	PyObject *obBatch = PyObject_GetAttrString(instance, "_com_batch_calls_");
+	if (obBatch == NULL)
+		PyErr_Clear();
+	else if (PyObject_IsTrue(obBatch) == 1)
+		m_pBatch = new PyXPCOM_CallBatch();
+	Py_XDECREF(obBatch);
+	PyErr_Clear();
+
+	if (m_pBaseObject) {
 		// Temp scope for lock. Ensures some other thread isn't doing a
 		// anything with our stubs at the same time.
-		CEnterLeaveXPCOMFramework _celf;
-		if (m_pBaseObject) {
-			// Put ourselves at the front of the chain (makes it
-			// easier to deal with).
-			PyXPCOM_XPTStub* stub = (PyXPCOM_XPTStub*)m_pBaseObject;
-			m_pNextObject = stub->m_pNextObject;
-			stub->m_pNextObject = this;
-		}
+		CEnterLeaveObjectLock _celo(m_pBaseObject);
+		m_pBaseObject->m_stubs.Add(m_iid, mXPTCStub);
 	}
 }
 
 PyXPCOM_XPTStub::~PyXPCOM_XPTStub()
 {
-	// Ensures some other thread isn't doing a anything with our stub at
-	// the same time.
-	CEnterLeaveXPCOMFramework _celf;
+	// Any queued calls hold a reference to us via their flush event,
+	// so there can be nothing left in the batch by now.
+	delete m_pBatch;
+	if (m_pDispatchTable) {
+		CEnterLeavePython _celp;
+		Py_DECREF(m_pDispatchTarget);
+		Py_DECREF(m_pDispatchTable);
+	}
 	if (m_pBaseObject) {
-		// Remove ourself from the m_pNextObject chain.
-		PyXPCOM_XPTStub* stub = (PyXPCOM_XPTStub*)m_pBaseObject;
-		while (stub && stub->m_pNextObject != this)
-			stub = stub->m_pNextObject;
-		if (stub) {
-			stub->m_pNextObject = this->m_pNextObject;
-		}
+		// Ensures some other thread isn't doing a anything with our stub at
+		// the same time.
+		CEnterLeaveObjectLock _celo(m_pBaseObject);
+		m_pBaseObject->m_stubs.Remove(m_iid, mXPTCStub);
 	}
 }
 
@@ -94,25 +376,6 @@ void *PyXPCOM_XPTStub::ThisAsIID(const nsIID &iid)
 	if (iid.Equals(NS_GET_IID(nsISupports)) || iid.Equals(m_iid)) {
 		return mXPTCStub;
 	}
-	
-	// Check for an existing stub that implements this interface, to make
-	// QIing to the same interface return the same stub.  This makes the
-	// objects easier to use from python (no need to keep a reference to
-	// the wrapped object just to find it again).
-	{
-		// Temp scope for lock. Ensures some other thread isn't doing a
-		// anything with these stubs at the same time.
-		CEnterLeaveXPCOMFramework _celf;
-		PyXPCOM_XPTStub* next = this;
-		if (m_pBaseObject) {
-			next = (PyXPCOM_XPTStub*)m_pBaseObject;
-		}
-		for (; next; next = next->m_pNextObject) {
-			if (iid.Equals(next->m_iid)) {
-				return next->mXPTCStub;
-			}
-		}
-	}
 	return PyG_Base::ThisAsIID(iid);
 }
 
@@ -126,19 +389,65 @@ PyXPCOM_XPTStub::CallMethod(PRUint16 methodIndex,
 	nsresult rc = NS_ERROR_FAILURE;
 	NS_PRECONDITION(info, "NULL methodinfo pointer");
 	NS_PRECONDITION(params, "NULL variant pointer");
+	if (m_pBatch) {
+		bool batchable = IsBatchableMethod(info);
+		bool queued = false, first = false, flush = false;
+		PRThread *thread = PR_GetCurrentThread();
+		PR_Lock(m_pBatch->lock);
+		bool ours = m_pBatch->calls.IsEmpty() || m_pBatch->thread == thread;
+		if (batchable && ours) {
+			PyXPCOM_PendingCall *call = m_pBatch->calls.AppendElement();
+			call->methodIndex = methodIndex;
+			call->info = info;
+			CopyBatchParams(info, params, call->params);
+			first = m_pBatch->calls.Length() == 1;
+			m_pBatch->thread = thread;
+			queued = true;
+		} else if (ours && !m_pBatch->calls.IsEmpty()) {
+			// Deliver what is queued before this call, so the object
+			// sees the calls in the order they were made.
+			flush = true;
+		}
+		PR_Unlock(m_pBatch->lock);
+		if (queued) {
+			if (first) {
+				nsCOMPtr<nsIRunnable> event = new PyXPCOM_FlushBatchEvent(this);
+				if (NS_FAILED(NS_DispatchToCurrentThread(event)))
+					// No event loop on this thread - deliver it now.
+					FlushBatch();
+			}
+			return NS_OK;
+		}
+		if (flush)
+			FlushBatch();
+		// Calls made on another thread while this one has calls queued
+		// are simply delivered immediately.
+	}
 	CEnterLeavePython _celp;
 	PyObject *obParams = NULL;
 	PyObject *result = NULL;
 	PyObject *obThisObject = NULL;
-	PyObject *obMI = PyObject_FromXPTMethodDescriptor(info);
+	PyObject *obMI = NULL;
 	PyXPCOM_GatewayVariantHelper arg_helper(this, methodIndex, info, params);
+	obParams = arg_helper.MakePyArgs();
+	if (obParams==NULL)
+		goto done;
+	{
+	PyObject *entry = GetDispatchEntry(methodIndex);
+	if (entry) {
+		// Errors are handled below exactly as if _CallMethod_ failed.
+		rc = CallDispatchEntry(entry, obParams, arg_helper);
+		goto done;
+	}
+	}
+	// Only _CallMethod_ (and the error handler) need these.
+	obMI = PyXPCOM_GetMethodDescriptorTuple(info);
 	if (obMI==NULL)
 		goto done;
 	// base object is passed raw.
 	obThisObject = PyObject_FromNSInterface((nsISupports *)ThisAsIID(m_iid),
 	                                        m_iid, false);
-	obParams = arg_helper.MakePyArgs();
-	if (obParams==NULL)
+	if (obThisObject==NULL)
 		goto done;
 	result = PyObject_CallMethod(m_pPyObject, 
 	                             "_CallMethod_",
@@ -175,13 +484,21 @@ done:
 		PyErr_Fetch(&exc_typ, &exc_val, &exc_tb);
 		PyErr_NormalizeException( &exc_typ, &exc_val, &exc_tb);
 
+		// The dispatch table path doesn't build the _CallMethod_ args,
+		// so build any the handler still needs.
+		if (obMI==NULL)
+			obMI = PyXPCOM_GetMethodDescriptorTuple(info);
+		if (obThisObject==NULL)
+			obThisObject = PyObject_FromNSInterface((nsISupports *)ThisAsIID(m_iid),
+			                                        m_iid, false);
+		PyErr_Clear();
 		PyObject *err_result = PyObject_CallMethod(m_pPyObject, 
 		                                           "_CallMethodException_",
 		                                           "OiOO(OOO)",
-		                                           obThisObject,
+		                                           obThisObject ? obThisObject : Py_None,
 		                                           (int)methodIndex,
-		                                           obMI,
-		                                           obParams,
+		                                           obMI ? obMI : Py_None,
+		                                           obParams ? obParams : Py_None,
 		                                           exc_typ ? exc_typ : Py_None, // should never be NULL, but defensive programming...
 		                                           exc_val ? exc_val : Py_None, // may well be NULL.
 		                                           exc_tb ? exc_tb : Py_None); // may well be NULL.
@@ -221,3 +538,166 @@ done:
 	Py_XDECREF(result);
 	return rc;
 }
+
+// Kinds of entries in a dispatch table - must match the DISPATCH_*
+// constants in xpcom/server/policy.py
+enum {
+	DISPATCH_CALL = 0,     // getattr(obj, name)(*params)
+	DISPATCH_GET_ATTR = 1, // getattr(obj, name)
+	DISPATCH_SET_ATTR = 2  // setattr(obj, name, params[0])
+};
+
+void PyXPCOM_XPTStub::LoadDispatchTable()
+{
+	m_bDispatchTableLoaded = true;
+	// Policies needn't implement this.
+	if (!PyObject_HasAttrString(m_pPyObject, "_GetDispatchTable_"))
+		return;
+	PyObject *ret = PyObject_CallMethod(m_pPyObject, "_GetDispatchTable_", NULL);
+	PyObject *target, *table;
+	if (ret == NULL) {
+		PyXPCOM_LogError("The policy's _GetDispatchTable_ failed\n");
+		PyErr_Clear();
+		return;
+	}
+	if (ret == Py_None) {
+		Py_DECREF(ret);
+		return;
+	}
+	if (!PyArg_ParseTuple(ret, "OO!:_GetDispatchTable_", &target, &PyTuple_Type, &table)) {
+		PyXPCOM_LogError("The policy's _GetDispatchTable_ returned an invalid result\n");
+		PyErr_Clear();
+		Py_DECREF(ret);
+		return;
+	}
+	// Check the entries once here, so calls can use them blindly.
+	for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(table); i++) {
+		PyObject *entry = PyTuple_GET_ITEM(table, i);
+		if (entry == Py_None)
+			continue;
+		if (!PyTuple_Check(entry) || PyTuple_GET_SIZE(entry) != 2 ||
+		    !PyInt_Check(PyTuple_GET_ITEM(entry, 0)) ||
+		    !PyString_Check(PyTuple_GET_ITEM(entry, 1))) {
+			PyXPCOM_LogError("The dispatch table entry for method %d is invalid\n", (int)i);
+			Py_DECREF(ret);
+			return;
+		}
+	}
+	Py_INCREF(target);
+	Py_INCREF(table);
+	m_pDispatchTarget = target;
+	m_pDispatchTable = table;
+	Py_DECREF(ret);
+}
+
+// Returns a borrowed reference to the dispatch table entry for the method,
+// or NULL if the call must go via the policy.
+PyObject *PyXPCOM_XPTStub::GetDispatchEntry(PRUint16 methodIndex)
+{
+	if (!m_bDispatchTableLoaded)
+		LoadDispatchTable();
+	if (!m_pDispatchTable || methodIndex >= PyTuple_GET_SIZE(m_pDispatchTable))
+		return NULL;
+	PyObject *entry = PyTuple_GET_ITEM(m_pDispatchTable, methodIndex);
+	return entry == Py_None ? NULL : entry;
+}
+
+// Make the call as DefaultPolicy._CallMethod_ would, but without the
+// policy.  On failure, a Python exception is left set for our caller.
+nsresult PyXPCOM_XPTStub::CallDispatchEntry(PyObject *entry, PyObject *obParams,
+                                            PyXPCOM_GatewayVariantHelper &arg_helper)
+{
+	long kind = PyInt_AS_LONG(PyTuple_GET_ITEM(entry, 0));
+	PyObject *name = PyTuple_GET_ITEM(entry, 1);
+	PyObject *ret = NULL;
+	switch (kind) {
+	  case DISPATCH_CALL: {
+		PyObject *func = PyObject_GetAttr(m_pDispatchTarget, name);
+		if (func) {
+			ret = PyObject_Call(func, obParams, NULL);
+			Py_DECREF(func);
+		}
+		break;
+		}
+	  case DISPATCH_GET_ATTR:
+		ret = PyObject_GetAttr(m_pDispatchTarget, name);
+		break;
+	  case DISPATCH_SET_ATTR:
+		if (PyTuple_GET_SIZE(obParams) != 1) {
+			PyErr_SetString(PyExc_TypeError, "Can only handle a single [in] arg for a default setter");
+			break;
+		}
+		if (PyObject_SetAttr(m_pDispatchTarget, name, PyTuple_GET_ITEM(obParams, 0)) == 0)
+			return NS_OK;
+		break;
+	  default:
+		PyErr_Format(PyExc_ValueError, "Unknown dispatch table entry kind %ld", kind);
+		break;
+	}
+	if (ret == NULL)
+		return NS_ERROR_FAILURE;
+	nsresult rc = arg_helper.ProcessUserResult(ret);
+	Py_DECREF(ret);
+	return rc;
+}
+
+void PyXPCOM_XPTStub::FlushBatch()
+{
+	MOZ_ASSERT(m_pBatch, "Not batching calls!");
+	nsTArray<PyXPCOM_PendingCall> calls;
+	PR_Lock(m_pBatch->lock);
+	calls.SwapElements(m_pBatch->calls);
+	m_pBatch->thread = nullptr;
+	PR_Unlock(m_pBatch->lock);
+	if (calls.IsEmpty())
+		return;
+	{
+	CEnterLeavePython _celp;
+	PyObject *obThisObject = PyObject_FromNSInterface((nsISupports *)ThisAsIID(m_iid),
+	                                                  m_iid, false);
+	PyObject *obCalls = PyList_New(0);
+	PyObject *result = NULL;
+	if (obCalls == NULL)
+		goto done;
+	for (PRUint32 i = 0; i < calls.Length(); i++) {
+		PyXPCOM_PendingCall &call = calls[i];
+		PyObject *obMI = PyXPCOM_GetMethodDescriptorTuple(call.info);
+		PyXPCOM_GatewayVariantHelper arg_helper(this, call.methodIndex,
+		                                        call.info, call.params.Elements());
+		PyObject *obParams = obMI ? arg_helper.MakePyArgs() : NULL;
+		PyObject *obCall = obParams ? Py_BuildValue("iOO", (int)call.methodIndex,
+		                                            obMI, obParams) : NULL;
+		Py_XDECREF(obMI);
+		Py_XDECREF(obParams);
+		if (obCall == NULL || PyList_Append(obCalls, obCall) != 0) {
+			// The call can't be delivered, but the others still can.
+			Py_XDECREF(obCall);
+			PyXPCOM_LogError("Failed to build the batched call to '%s'\n",
+			                 call.info->name);
+			PyErr_Clear();
+			continue;
+		}
+		Py_DECREF(obCall);
+	}
+	// Errors from the individual calls are handled by the policy
+	// (normally via _CallMethodException_); there is no caller left to
+	// report anything to.
+	result = PyObject_CallMethod(m_pPyObject,
+	                             "_CallMethodBatch_",
+	                             "OO",
+	                             obThisObject,
+	                             obCalls);
+done:
+	if (result == NULL) {
+		PyXPCOM_LogError("The batched calls on '%s' failed\n",
+		                 calls[0].info->name);
+		PyErr_Clear();
+	}
+	Py_XDECREF(result);
+	Py_XDECREF(obCalls);
+	Py_XDECREF(obThisObject);
+	}
+	// Without the GIL - releasing interfaces may call back into Python.
+	for (PRUint32 i = 0; i < calls.Length(); i++)
+		FreeBatchParams(calls[i].info, calls[i].params);
+}
@@ -51,6 +51,7 @@
 PyXPCOM_GatewayWeakReference::PyXPCOM_GatewayWeakReference( PyG_Base *base )
 {
 	m_pBase = base;
+	m_lockKey = base;
 
 #ifdef NS_BUILD_REFCNT_LOGGING
 	// bloat view uses 40 chars - stick "(WR)" at the end of this position.
@@ -79,11 +80,12 @@ PyXPCOM_GatewayWeakReference::QueryReferent(REFNSIID iid, void * *ret)
 		// Temp scope for lock. We can't hold the lock during a QI, as
 		// this may itself need the lock, so we add a keepalive
 		// reference to prevent the object dieing whilst we query it.
-		CEnterLeaveXPCOMFramework _celf;
-		if (m_pBase == NULL)
+		// PyG_Base::Release drops the reference count without the lock,
+		// so the object may have just lost its last reference and be
+		// waiting on the lock to detach us.
+		CEnterLeaveObjectLock _celo(m_lockKey);
+		if (m_pBase == NULL || !m_pBase->AddRefIfAlive())
 			return NS_ERROR_NULL_POINTER;
-		// Add a keepalive reference - can't die while we have a ref.
-		m_pBase->AddRef();
 	} // end of lock scope - lock unlocked.
 	nsresult nr = m_pBase->QueryInterface(iid, ret);
 	// Can now release our additional keepalive reference we added.
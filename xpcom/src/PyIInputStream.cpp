@@ -61,39 +61,77 @@ static nsIInputStream *GetI(PyObject *self) {
 	return (nsIInputStream *)Py_nsISupports::GetI(self);
 }
 
+// nsIInputStream::Read can only take 32 bits worth of count; read up to |n|
+// bytes into |buf| in chunks.  As for a single Read(), we stop as soon as a
+// chunk comes back short (end of stream, or a non-blocking stream that has
+// nothing more right now), so callers see the same semantics as before for
+// anything that fits in a single chunk.
+static nsresult DoReadChunked(nsIInputStream *pI, char *buf, PRUint64 n,
+                              PRUint64 *nread_out)
+{
+	nsresult r = NS_OK;
+	PRUint64 total = 0;
+	Py_BEGIN_ALLOW_THREADS;
+	do {
+		PRUint64 left = n - total;
+		PRUint32 chunk = left > PR_UINT32_MAX ? PR_UINT32_MAX
+		                                      : static_cast<PRUint32>(left);
+		PRUint32 nread = 0;
+		r = pI->Read(buf + total, chunk, &nread);
+		if (NS_FAILED(r))
+			break;
+		total += nread;
+		if (nread < chunk)
+			break;
+	} while (total < n);
+	Py_END_ALLOW_THREADS;
+	*nread_out = total;
+	return r;
+}
+
 static PyObject *DoPyRead_Buffer(nsIInputStream *pI, PyObject *obBuffer, PRUint64 n)
 {
-	PRUint32 nread;
 	void *buf;
 	Py_ssize_t buf_len;
+#if PY_VERSION_HEX >= 0x02060000
+	// New-style buffers (bytearray, memoryview, etc)
+	Py_buffer view;
+	bool have_view = false;
+	if (PyObject_CheckBuffer(obBuffer)) {
+		if (PyObject_GetBuffer(obBuffer, &view, PyBUF_WRITABLE | PyBUF_SIMPLE) != 0) {
+			PyErr_Clear();
+			PyErr_SetString(PyExc_TypeError, "The buffer object does not have a write buffer!");
+			return NULL;
+		}
+		have_view = true;
+		buf = view.buf;
+		buf_len = view.len;
+	} else
+#endif
 	if (PyObject_AsWriteBuffer(obBuffer, &buf, &buf_len) != 0) {
 		PyErr_Clear();
 		PyErr_SetString(PyExc_TypeError, "The buffer object does not have a write buffer!");
 		return NULL;
 	}
 
-	if ( (buf_len & 0xFFFFFFFF) != buf_len) {
-		PyErr_Clear();
-		PyErr_SetString(PyExc_RuntimeError, "Python Buffer length overflows 32-bit in PyObject_AsWriteBuffer");
-		return NULL;
-	}
-
 	if (n==(PRUint64)-1) {
 		n = buf_len;
 	} else {
-		if (n > buf_len) {
+		if (n > (PRUint64)buf_len) {
 			NS_WARNING("Warning: PyIInputStream::read() was passed an integer size greater than the size of the passed buffer!  Buffer size used.\n");
 			n = buf_len;
 		}
 	}
-	nsresult r;
-	MOZ_ASSERT(n == static_cast<uint32_t>(n), "Reading too much");
-	Py_BEGIN_ALLOW_THREADS;
-	r = pI->Read((char *)buf, static_cast<uint32_t>(n), &nread);
-	Py_END_ALLOW_THREADS;
+	PRUint64 nread;
+	nsresult r = DoReadChunked(pI, (char *)buf, n, &nread);
+#if PY_VERSION_HEX >= 0x02060000
+	if (have_view)
+		PyBuffer_Release(&view);
+#endif
 	if ( NS_FAILED(r) )
 		return PyXPCOM_BuildPyException(r);
-	return PyInt_FromLong(nread);
+	// nread <= buf_len, so this fits
+	return PyInt_FromSsize_t(static_cast<Py_ssize_t>(nread));
 }
 
 static PyObject *DoPyRead_Size(nsIInputStream *pI, PY_LONG_LONG n)
@@ -107,46 +145,53 @@ static PyObject *DoPyRead_Size(nsIInputStream *pI, PY_LONG_LONG n)
 			return PyXPCOM_BuildPyException(r);
 		MOZ_ASSERT(n >= 0, "Too much available");
 	}
-	if (n == 0) { // mozilla will assert if we alloc zero bytes.
-		return PyBuffer_New(0);
+	if (n < 0 || (PRUint64)n > (PRUint64)PY_SSIZE_T_MAX) {
+		PyErr_SetString(PyExc_OverflowError, "Can't read that many bytes into a single buffer");
+		return NULL;
 	}
-	char *buf = (char *)moz_malloc(static_cast<size_t>(n));
-	if (buf==NULL) {
-		PyErr_NoMemory();
+	// Read straight into the buffer we will return.
+	PyObject *rc = PyBuffer_New(static_cast<Py_ssize_t>(n));
+	if (rc == NULL || n == 0)
+		return rc;
+	void *ob_buf;
+	Py_ssize_t buf_len;
+	if (PyObject_AsWriteBuffer(rc, &ob_buf, &buf_len) != 0) {
+		// should never fail - we just created it!
+		Py_DECREF(rc);
 		return NULL;
 	}
-	nsresult r;
-	PRUint32 nread;
-	MOZ_ASSERT(n == static_cast<uint32_t>(n), "Reading too much");
-	Py_BEGIN_ALLOW_THREADS;
-	r = pI->Read(buf, static_cast<uint32_t>(n), &nread);
-	Py_END_ALLOW_THREADS;
-	PyObject *rc = NULL;
-	if ( NS_SUCCEEDED(r) ) {
-		rc = PyBuffer_New(nread);
-		if (rc != NULL) {
-			void *ob_buf;
-			Py_ssize_t buf_len;
-			if (PyObject_AsWriteBuffer(rc, &ob_buf, &buf_len) != 0) {
-				// should never fail - we just created it!
-				return NULL;
-			}
-
-			if ( (buf_len & 0xFFFFFFFF) != buf_len) {
-				PyErr_SetString(PyExc_RuntimeError, "Python Buffer length overflows 32-bit in PyObject_AsWriteBuffer");
-				return NULL;
-			}
-
-			if (buf_len != nread) {
-				PyErr_SetString(PyExc_RuntimeError, "New buffer isn't the size we created it!");
-				return NULL;
+	MOZ_ASSERT(buf_len == n, "New buffer isn't the size we created it!");
+	PRUint64 nread;
+	nsresult r = DoReadChunked(pI, (char *)ob_buf, n, &nread);
+	if ( NS_FAILED(r) ) {
+		Py_DECREF(rc);
+		return PyXPCOM_BuildPyException(r);
+	}
+	if (nread == (PRUint64)n)
+		return rc;
+	PyObject *ret;
+	if (nread > (PRUint64)n / 2) {
+		// A short read; hand back a view of just the part that was filled
+		// rather than copying it.
+		ret = PyBuffer_FromReadWriteObject(rc, 0,
+		                                   static_cast<Py_ssize_t>(nread));
+	} else {
+		// Most of the buffer is unused - a view would keep it all alive
+		// as long as the result, so copy into one of the right size.
+		ret = PyBuffer_New(static_cast<Py_ssize_t>(nread));
+		if (ret && nread) {
+			void *ret_buf;
+			Py_ssize_t ret_len;
+			if (PyObject_AsWriteBuffer(ret, &ret_buf, &ret_len) == 0) {
+				memcpy(ret_buf, ob_buf, static_cast<size_t>(nread));
+			} else {
+				Py_DECREF(ret);
+				ret = NULL;
 			}
-			memcpy(ob_buf, buf, nread);
 		}
-	} else
-		PyXPCOM_BuildPyException(r);
-	nsMemory::Free(buf);
-	return rc;
+	}
+	Py_DECREF(rc);
+	return ret;
 }
 
 static PyObject *PyRead(PyObject *self, PyObject *args)
@@ -170,11 +215,27 @@ static PyObject *PyRead(PyObject *self, PyObject *args)
 	return DoPyRead_Buffer(pI, obBuffer, n);
 }
 
+// readinto(buffer_ob, int_size=-1) - like the file method, fills the given
+// writable buffer in-place and returns the number of bytes read.
+static PyObject *PyReadInto(PyObject *self, PyObject *args)
+{
+	PyObject *obBuffer = NULL;
+	PY_LONG_LONG n = (PY_LONG_LONG)-1;
+
+	nsIInputStream *pI = GetI(self);
+	if (pI==NULL)
+		return NULL;
+	if (!PyArg_ParseTuple(args, "O|L:readinto", &obBuffer, &n))
+		return NULL;
+	return DoPyRead_Buffer(pI, obBuffer, n);
+}
+
 
 struct PyMethodDef 
 PyMethods_IInputStream[] =
 {
 	{ "read", PyRead, 1},
+	{ "readinto", PyReadInto, 1},
 	// The rest are handled as normal
 	{NULL}
 };
@@ -188,6 +188,214 @@ static PyObject *PyFetchBlock(PyObject *self, PyObject *args)
 	return ret;
 }
 
+// PyXPCOM_EnumeratorIter - a Python iterator over an nsISimpleEnumerator.
+// Like FetchBlock, elements are fetched in blocks with the thread-lock
+// released and wrapped a block at a time, so the loop only crosses into
+// XPCOM once per block.  Blocks start small and grow, so breaking out of
+// a loop early doesn't consume many more elements than were used.
+#define ENUM_ITER_FIRST_BLOCK 8
+#define ENUM_ITER_MAX_BLOCK 256
+
+class PyXPCOM_EnumeratorIter : public PyObject
+{
+public:
+	// If bQI, the elements are QI'd for iid as they are fetched.
+	PyXPCOM_EnumeratorIter(PyObject *obEnum, const nsIID &iid, bool bQI);
+	~PyXPCOM_EnumeratorIter();
+
+	static PyTypeObject type;
+	static PyObject *PyTypeMethod_iternext(PyObject *self);
+	static void PyTypeMethod_dealloc(PyObject *self);
+protected:
+	// Fetch the next block - false (with a Python exception) on error.
+	bool FetchBlock();
+
+	PyObject *m_obEnum; // The Py_nsISimpleEnumerator we are iterating.
+	nsIID m_iid;
+	bool m_bQI;
+	bool m_bDone; // The enumerator has no more elements.
+	int m_blockSize;
+	// The current block - we hand out our reference to each item.
+	PyObject *m_items[ENUM_ITER_MAX_BLOCK];
+	int m_numItems;
+	int m_pos;
+};
+
+PyXPCOM_EnumeratorIter::PyXPCOM_EnumeratorIter(PyObject *obEnum,
+                                               const nsIID &iid, bool bQI)
+{
+	ob_type = &type;
+	_Py_NewReference(this);
+	m_obEnum = obEnum;
+	Py_INCREF(obEnum);
+	m_iid = iid;
+	m_bQI = bQI;
+	m_bDone = false;
+	m_blockSize = ENUM_ITER_FIRST_BLOCK;
+	m_numItems = m_pos = 0;
+}
+
+PyXPCOM_EnumeratorIter::~PyXPCOM_EnumeratorIter()
+{
+	for (; m_pos < m_numItems; m_pos++)
+		Py_DECREF(m_items[m_pos]);
+	Py_DECREF(m_obEnum);
+}
+
+bool PyXPCOM_EnumeratorIter::FetchBlock()
+{
+	nsISimpleEnumerator *pI = GetI(m_obEnum);
+	if (pI==NULL)
+		return false;
+
+	nsISupports *fetched[ENUM_ITER_MAX_BLOCK];
+	int n_wanted = m_blockSize;
+	int n_fetched = 0;
+	nsresult r = NS_OK;
+	bool more;
+	Py_BEGIN_ALLOW_THREADS;
+	for (;n_fetched<n_wanted;) {
+		r = pI->HasMoreElements(&more);
+		if (NS_FAILED(r) || !more)
+			break;
+		nsISupports *pNew;
+		r = pI->GetNext(&pNew);
+		if (NS_FAILED(r))
+			break;
+		if (m_bQI && pNew) {
+			nsISupports *temp;
+			r = pNew->QueryInterface(m_iid, (void **)&temp);
+			pNew->Release();
+			if (NS_FAILED(r))
+				break;
+			pNew = temp;
+		}
+		fetched[n_fetched] = pNew;
+		n_fetched++;
+	}
+	Py_END_ALLOW_THREADS;
+	if (NS_FAILED(r)) {
+		Py_BEGIN_ALLOW_THREADS;
+		for (int i=0;i<n_fetched;i++)
+			NS_IF_RELEASE(fetched[i]);
+		Py_END_ALLOW_THREADS;
+		PyXPCOM_BuildPyException(r);
+		return false;
+	}
+	if (n_fetched < n_wanted)
+		m_bDone = true;
+	else if (m_blockSize < ENUM_ITER_MAX_BLOCK)
+		m_blockSize *= 2;
+
+	m_pos = m_numItems = 0;
+	bool ok = true;
+	for (int i=0;i<n_fetched;i++) {
+		if (ok) {
+			PyObject *new_ob = Py_nsISupports::PyObjectFromInterface(fetched[i], m_iid);
+			if (new_ob)
+				m_items[m_numItems++] = new_ob;
+			else
+				ok = false;
+		}
+		NS_IF_RELEASE(fetched[i]);
+	}
+	return ok;
+}
+
+/*static*/ PyObject *
+PyXPCOM_EnumeratorIter::PyTypeMethod_iternext(PyObject *self)
+{
+	PyXPCOM_EnumeratorIter *me = (PyXPCOM_EnumeratorIter *)self;
+	if (me->m_pos >= me->m_numItems) {
+		if (me->m_bDone)
+			return NULL; // StopIteration
+		if (!me->FetchBlock())
+			return NULL;
+		if (me->m_numItems == 0)
+			return NULL;
+	}
+	return me->m_items[me->m_pos++];
+}
+
+/*static*/ void
+PyXPCOM_EnumeratorIter::PyTypeMethod_dealloc(PyObject *self)
+{
+	delete (PyXPCOM_EnumeratorIter *)self;
+}
+
+// @object PyXPCOM_EnumeratorIter|An iterator over an nsISimpleEnumerator.
+PyTypeObject PyXPCOM_EnumeratorIter::type =
+{
+	PyObject_HEAD_INIT(&PyType_Type)
+	0,
+	"EnumeratorIterator",
+	sizeof(PyXPCOM_EnumeratorIter),
+	0,
+	PyTypeMethod_dealloc,                           /* tp_dealloc */
+	0,                                              /* tp_print */
+	0,                                              /* tp_getattr */
+	0,                                              /* tp_setattr */
+	0,                                              /* tp_compare */
+	0,                                              /* tp_repr */
+	0,                                              /* tp_as_number */
+	0,                                              /* tp_as_sequence */
+	0,                                              /* tp_as_mapping */
+	0,                                              /* tp_hash */
+	0,                                              /* tp_call */
+	0,                                              /* tp_str */
+	PyObject_GenericGetAttr,                        /* tp_getattro */
+	0,                                              /* tp_setattro */
+	0,                                              /* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,                             /* tp_flags */
+	0,                                              /* tp_doc */
+	0,                                              /* tp_traverse */
+	0,                                              /* tp_clear */
+	0,                                              /* tp_richcompare */
+	0,                                              /* tp_weaklistoffset */
+	PyObject_SelfIter,                              /* tp_iter */
+	PyTypeMethod_iternext,                          /* tp_iternext */
+};
+
+// tp_iter for the enumerator itself.
+static PyObject *PyEnumIter(PyObject *self)
+{
+	if (GetI(self)==NULL)
+		return NULL;
+	return new PyXPCOM_EnumeratorIter(self, NS_GET_IID(nsISupports), false);
+}
+
+// Iterate([iid]) - an iterator which also QIs each element for iid.
+// Also exposed as __iter__ for xpcom.client wrappers.
+static PyObject *PyIterate(PyObject *self, PyObject *args)
+{
+	PyObject *obIID = NULL;
+	if (!PyArg_ParseTuple(args, "|O:Iterate", &obIID))
+		return NULL;
+
+	nsIID iid(NS_GET_IID(nsISupports));
+	if (obIID != NULL && !Py_nsIID::IIDFromPyObject(obIID, &iid))
+		return NULL;
+	if (GetI(self)==NULL)
+		return NULL;
+	return new PyXPCOM_EnumeratorIter(self, iid, obIID != NULL);
+}
+
+/*static*/ void
+Py_nsISimpleEnumerator::InitType()
+{
+	type = new PyXPCOM_TypeObject(
+			"nsISimpleEnumerator",
+			Py_nsISupports::type,
+			sizeof(Py_nsISimpleEnumerator),
+			PyMethods_ISimpleEnumerator,
+			Constructor);
+	type->tp_flags |= Py_TPFLAGS_HAVE_ITER;
+	type->tp_iter = PyEnumIter;
+	RegisterInterface(NS_GET_IID(nsISimpleEnumerator), type);
+	// Builds the iterator's __iter__ and next methods from its slots.
+	if (PyType_Ready(&PyXPCOM_EnumeratorIter::type) < 0)
+		PyXPCOM_LogError("Failed to initialize the enumerator iterator type\n");
+}
 
 struct PyMethodDef 
 PyMethods_ISimpleEnumerator[] =
@@ -198,5 +406,8 @@ PyMethods_ISimpleEnumerator[] =
 	{ "getNext", PyGetNext, 1},
 	{ "FetchBlock", PyFetchBlock, 1},
 	{ "fetchBlock", PyFetchBlock, 1},
+	{ "Iterate", PyIterate, 1},
+	{ "iterate", PyIterate, 1},
+	{ "__iter__", PyIterate, 1},
 	{NULL}
 };
@@ -49,10 +49,38 @@
 #include "pratom.h"
 #include "nsISupportsPrimitives.h"
 #include "nsThreadUtils.h"
-#include "nsProxyRelease.h"
 
 static PRInt32 cInterfaces=0;
-static PyObject *g_obFuncMakeInterfaceCount = NULL; // XXX - never released!!!
+
+// For building xpcom.client.Component objects - see MakeDefaultWrapper.
+static PyObject *g_obComponentClass = NULL;
+// xpcom.client's __dict__, and the MakeInterfaceResult it was loaded with.
+// We only build Components natively while that hook is in place.
+static PyObject *g_obClientDict = NULL;
+static PyObject *g_obDefaultMakeResult = NULL;
+static PyObject *g_obMakeResultName = NULL;
+// The items shared by the __dict__ of every new Component.
+static PyObject *g_obComponentTemplate = NULL;
+// Interned names of the per-instance items.
+static PyObject *g_obComObjName = NULL;
+static PyObject *g_obPendingIIDName = NULL;
+#define NUM_COMPONENT_DICTS 4
+static const char *g_componentDictNames[NUM_COMPONENT_DICTS] = {
+	"_interfaces_", "_interface_names_", "_interface_infos_",
+	"_name_to_interface_iid_"
+};
+static PyObject *g_obComponentDictNames[NUM_COMPONENT_DICTS];
+// A Py_nsIID for each IID we have wrapped a Component for, shared
+// between all of them.
+typedef nsDataHashtable<nsIDHashKey, PyObject *> IIDObjectMap;
+static IIDObjectMap *g_iidObjects = nullptr;
+// Set by PyXPCOM_ShutdownComponentCache - we no longer share IIDs then.
+static bool g_bComponentCacheShutdown = false;
+// When enabled, maps (canonical nsISupports, IID) to a weak reference to
+// the Component last returned for it, so an object handed back to Python
+// repeatedly keeps the same wrapper - see PyObjectFromInterface.
+static bool g_bIdentityCacheEnabled = false;
+static PyObject *g_obIdentityCache = NULL;
 
 PyObject *
 PyObject_FromNSInterface(nsISupports *aInterface,
@@ -74,6 +102,7 @@ Py_nsISupports::Py_nsISupports(nsISupports *punk, const nsIID &iid, PyTypeObject
 	ob_type = this_type;
 	m_obj = punk;
 	m_iid = iid;
+	m_pIdentity = nullptr;
 	// refcnt of object managed by caller.
 	PR_ATOMIC_INCREMENT(&cInterfaces);
 	_Py_NewReference(this);
@@ -140,19 +169,90 @@ Py_nsISupports::GetI(PyObject *self, nsIID *ret_iid)
 	return pis->m_obj;
 }
 
+/*static*/ nsISupports *
+Py_nsISupports::GetIdentity(PyObject *self)
+{
+	Py_nsISupports *pis = (Py_nsISupports *)self;
+	if (pis->m_pIdentity)
+		return pis->m_pIdentity;
+	nsISupports *pMyIS = GetI(self);
+	if (pMyIS==NULL)
+		return NULL;
+	if (pis->m_iid.Equals(NS_GET_IID(nsISupports))) {
+		pis->m_pIdentity = pMyIS;
+		return pMyIS;
+	}
+	nsISupports *pUnk = nullptr;
+	nsresult r;
+	Py_BEGIN_ALLOW_THREADS
+	r = pMyIS->QueryInterface(NS_GET_IID(nsISupports), (void **)&pUnk);
+	Py_END_ALLOW_THREADS
+	if (NS_FAILED(r)) {
+		PyXPCOM_BuildPyException(r);
+		return NULL;
+	}
+	// m_obj holds the object alive, so we needn't keep this reference.
+	pUnk->Release();
+	pis->m_pIdentity = pUnk;
+	return pUnk;
+}
+
+// XPCOM instances need to be released on the main thread.  Those dropped
+// on other threads are pushed onto this (lock-free) list, and released
+// together by a single PyXPCOM_ReleaseEvent.  An event is posted only as
+// the list goes from empty to not, so there is one per batch.
+struct PyXPCOM_PendingRelease {
+	nsISupports *obj;
+	PyXPCOM_PendingRelease *next;
+};
+static mozilla::Atomic<PyXPCOM_PendingRelease *, mozilla::ReleaseAcquire> g_pendingReleases;
+
+// Take the whole list, releasing (or if we can't, leaking) each object.
+static void DrainPendingReleases(bool bRelease)
+{
+	PyXPCOM_PendingRelease *item = g_pendingReleases.exchange(nullptr);
+	while (item) {
+		PyXPCOM_PendingRelease *next = item->next;
+		if (bRelease)
+			item->obj->Release();
+		moz_free(item);
+		item = next;
+	}
+}
+
+class PyXPCOM_ReleaseEvent : public nsRunnable {
+public:
+	NS_IMETHOD Run() {
+		DrainPendingReleases(true);
+		return NS_OK;
+	}
+};
+
 /*static*/ void
 Py_nsISupports::SafeRelease(Py_nsISupports *ob)
 {
-	if (!ob)
+	if (!ob || !ob->m_obj)
+		return;
+	if (NS_IsMainThread()) {
+		ob->m_obj = nullptr;
 		return;
-	if (ob->m_obj)
-	{
-		Py_BEGIN_ALLOW_THREADS;
-		// XPCOM instances need to be released on the main thread.
-		nsCOMPtr<nsIThread> mMainThread;
-		NS_GetMainThread(getter_AddRefs(mMainThread));
-		NS_ProxyRelease(mMainThread, ob->m_obj);
-		Py_END_ALLOW_THREADS;
+	}
+	PyXPCOM_PendingRelease *item = static_cast<PyXPCOM_PendingRelease *>(
+		moz_xmalloc(sizeof(PyXPCOM_PendingRelease)));
+	ob->m_obj.forget(&item->obj);
+	PyXPCOM_PendingRelease *head;
+	do {
+		head = g_pendingReleases;
+		item->next = head;
+	} while (!g_pendingReleases.compareExchange(head, item));
+	if (head)
+		return; // an event is already on its way.
+	nsresult rv = NS_DispatchToMainThread(new PyXPCOM_ReleaseEvent());
+	if (NS_FAILED(rv)) {
+		// No main thread to release them on (ie, we are shutting down),
+		// so leak them as NS_ProxyRelease would.
+		NS_WARNING("Failed to dispatch release of XPCOM objects - leaking");
+		DrainPendingReleases(false);
 	}
 }
 
@@ -339,14 +439,63 @@ Py_nsISupports::InterfaceFromPyObject(PyObject *ob,
 Py_nsISupports::RegisterInterface( const nsIID &iid, PyTypeObject *t)
 {
 	if (mapIIDToType==NULL)
-		mapIIDToType = PyDict_New();
+		mapIIDToType = new TypeMap();
+	// The types are static, so need no reference.
+	mapIIDToType->Put(iid, t);
+}
+
+// The identity cache key - the raw bytes of the canonical nsISupports
+// pointer and the IID.
+static PyObject *MakeIdentityKey(nsISupports *pis, const nsIID &riid)
+{
+	nsCOMPtr<nsISupports> canonical;
+	if (riid.Equals(NS_GET_IID(nsISupports)))
+		canonical = pis;
+	else
+		canonical = do_QueryInterface(pis);
+	if (!canonical)
+		return NULL;
+	nsISupports *p = canonical;
+	char buf[sizeof(nsISupports *) + sizeof(nsIID)];
+	memcpy(buf, &p, sizeof(p));
+	memcpy(buf + sizeof(p), &riid, sizeof(riid));
+	return PyString_FromStringAndSize(buf, sizeof(buf));
+}
 
-	if (mapIIDToType) {
-		PyObject *key = Py_nsIID::PyObjectFromIID(iid);
-		if (key)
-			PyDict_SetItem(mapIIDToType, key, (PyObject *)t);
-		Py_XDECREF(key);
+// Called as a Component in the identity cache dies - self is its key.
+static PyObject *IdentityCacheCallback(PyObject *self, PyObject *ref)
+{
+	if (g_obIdentityCache) {
+		// Only remove the entry if it has not since been replaced.
+		PyObject *existing = PyDict_GetItem(g_obIdentityCache, self);
+		if (existing == ref && PyDict_DelItem(g_obIdentityCache, self) != 0)
+			PyErr_Clear();
 	}
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+static PyMethodDef g_identityCacheCallbackDef =
+	{"_identity_cache_callback", IdentityCacheCallback, METH_O};
+
+static void AddToIdentityCache(PyObject *key, PyObject *ob)
+{
+	PyObject *callback = PyCFunction_New(&g_identityCacheCallbackDef, key);
+	PyObject *ref = callback ? PyWeakref_NewRef(ob, callback) : NULL;
+	if (ref==NULL || PyDict_SetItem(g_obIdentityCache, key, ref) != 0)
+		// Just means the object doesn't get shared.
+		PyErr_Clear();
+	Py_XDECREF(ref);
+	Py_XDECREF(callback);
+}
+
+bool PyXPCOM_SetIdentityCacheEnabled(bool bEnable)
+{
+	bool bOld = g_bIdentityCacheEnabled;
+	g_bIdentityCacheEnabled = bEnable;
+	if (!bEnable)
+		Py_CLEAR(g_obIdentityCache);
+	return bOld;
 }
 
 /*static */PyObject *
@@ -370,28 +519,48 @@ Py_nsISupports::PyObjectFromInterface(nsISupports *pis,
 #endif
 	}
 
+	// If enabled, hand back the existing Component for this object.
+	PyObject *obIdentityKey = NULL;
+	if (g_bIdentityCacheEnabled && bMakeNicePyObject) {
+		if (g_obIdentityCache==NULL) {
+			g_obIdentityCache = PyDict_New();
+			if (g_obIdentityCache==NULL)
+				return NULL;
+		}
+		obIdentityKey = MakeIdentityKey(pis, riid);
+		if (obIdentityKey==NULL)
+			PyErr_Clear(); // no identity - just don't cache it.
+		else {
+			PyObject *ref = PyDict_GetItem(g_obIdentityCache, obIdentityKey);
+			PyObject *existing = ref ? PyWeakref_GET_OBJECT(ref) : NULL;
+			if (existing && existing != Py_None) {
+				Py_DECREF(obIdentityKey);
+				Py_INCREF(existing);
+				return existing;
+			}
+		}
+	}
+
 	PyTypeObject *createType = NULL;
 	// If the IID is for nsISupports, don't bother with
 	// a map lookup as we know the type!
 	if (!riid.Equals(NS_GET_IID(nsISupports))) {
 		// Look up the map
-		PyObject *obiid = Py_nsIID::PyObjectFromIID(riid);
-		if (!obiid) return NULL;
-
 		if (mapIIDToType != NULL)
-			createType = (PyTypeObject *)PyDict_GetItem(mapIIDToType, obiid);
-		Py_DECREF(obiid);
+			mapIIDToType->Get(riid, &createType);
 	}
 	if (createType==NULL)
 		createType = Py_nsISupports::type;
 	// Check it is indeed one of our types.
 	if (!PyXPCOM_TypeObject::IsType(createType)) {
+		Py_XDECREF(obIdentityKey);
 		PyErr_SetString(PyExc_RuntimeError, "The type map is invalid");
 		return NULL;
 	}
 	// we can now safely cast the thing to a PyComTypeObject and use it
 	PyXPCOM_TypeObject *myCreateType = (PyXPCOM_TypeObject *)createType;
 	if (myCreateType->ctor==NULL) {
+		Py_XDECREF(obIdentityKey);
 		PyErr_SetString(PyExc_TypeError, "The type does not declare a PyCom constructor");
 		return NULL;
 	}
@@ -401,46 +570,153 @@ Py_nsISupports::PyObjectFromInterface(nsISupports *pis,
 	PyXPCOM_LogF("XPCOM Object created at 0x%0xld, nsISupports at 0x%0xld",
 		ret, ret->m_obj);
 #endif
-	if (ret && bMakeNicePyObject)
-		return MakeDefaultWrapper(ret, riid);
+	if (ret && bMakeNicePyObject) {
+		PyObject *wrapper = MakeDefaultWrapper(ret, riid);
+		// Only a Component can be cached - MakeDefaultWrapper
+		// falls back to the raw interface on error.
+		if (obIdentityKey && g_obIdentityCache && PyInstance_Check(wrapper))
+			AddToIdentityCache(obIdentityKey, wrapper);
+		Py_XDECREF(obIdentityKey);
+		return wrapper;
+	}
+	Py_XDECREF(obIdentityKey);
 	return ret;
 }
 
-// Call back into Python, passing a raw nsIInterface object, getting back
-// the object to actually pass to Python.
+static bool InitComponentFactory()
+{
+	PyObject *mod = PyImport_ImportModule("xpcom.client");
+	if (mod==NULL)
+		return false;
+	PyObject *klass = PyObject_GetAttrString(mod, "Component");
+	PyObject *hook = PyObject_GetAttrString(mod, "_DefaultMakeInterfaceResult");
+	PyObject *dict = PyModule_GetDict(mod); // borrowed
+	Py_XINCREF(dict);
+	Py_DECREF(mod);
+	if (klass==NULL || hook==NULL || dict==NULL) {
+		Py_XDECREF(klass);
+		Py_XDECREF(hook);
+		Py_XDECREF(dict);
+		return false;
+	}
+	if (!PyClass_Check(klass)) {
+		PyErr_SetString(PyExc_TypeError, "xpcom.client.Component must be a classic class");
+		Py_DECREF(klass);
+		Py_DECREF(hook);
+		Py_DECREF(dict);
+		return false;
+	}
+	g_obComponentTemplate = Py_BuildValue("{s:i,s:s}",
+	                                      "_tried_classinfo_", 0,
+	                                      "_object_name_", "<unknown>");
+	if (g_obComponentTemplate==NULL) {
+		Py_DECREF(klass);
+		Py_DECREF(hook);
+		Py_DECREF(dict);
+		return false;
+	}
+	g_obClientDict = dict;
+	g_obDefaultMakeResult = hook;
+	g_obMakeResultName = PyString_InternFromString("MakeInterfaceResult");
+	g_obComObjName = PyString_InternFromString("_comobj_");
+	g_obPendingIIDName = PyString_InternFromString("_pending_iid_");
+	for (size_t i = 0; i < NUM_COMPONENT_DICTS; i++)
+		g_obComponentDictNames[i] = PyString_InternFromString(g_componentDictNames[i]);
+	g_obComponentClass = klass;
+	return true;
+}
+
+static PyObject *GetSharedIIDObject(const nsIID &iid)
+{
+	// Don't build a new table we would never release.
+	if (g_bComponentCacheShutdown)
+		return Py_nsIID::PyObjectFromIID(iid);
+	if (g_iidObjects==NULL)
+		g_iidObjects = new IIDObjectMap();
+	PyObject *ret = NULL;
+	if (!g_iidObjects->Get(iid, &ret)) {
+		ret = Py_nsIID::PyObjectFromIID(iid);
+		if (ret==NULL)
+			return NULL;
+		// The map keeps its own reference.
+		g_iidObjects->Put(iid, ret);
+	}
+	Py_INCREF(ret);
+	return ret;
+}
+
+static PLDHashOperator ReleaseIIDObject(const nsID &key,
+                                        PyObject *value,
+                                        void *userData)
+{
+	Py_DECREF(value);
+	return PLDHashOperator::PL_DHASH_NEXT;
+}
+
+void PyXPCOM_ShutdownComponentCache()
+{
+	g_bComponentCacheShutdown = true;
+	Py_CLEAR(g_obIdentityCache);
+	if (g_iidObjects) {
+		g_iidObjects->EnumerateRead(ReleaseIIDObject, nullptr);
+		delete g_iidObjects;
+		g_iidObjects = nullptr;
+	}
+}
+
+// Wrap a raw nsIInterface object in an xpcom.client.Component, the object
+// actually passed to Python.
+// We build the Component here rather than calling back into Python: the
+// instance gets the same __dict__ Component.__init__ would give it, with
+// the work of reflecting the interface itself deferred until the object
+// is first used (see Component._resolve_pending_iid_).  The interface
+// info that needs is built once per IID by xpcom.client.  If Python has
+// replaced xpcom.client.MakeInterfaceResult, we call that instead.
 PyObject *
 Py_nsISupports::MakeDefaultWrapper(PyObject *pyis, 
 			     const nsIID &iid)
 {
 	NS_PRECONDITION(pyis, "NULL pyobject!");
 	PyObject *obIID = NULL;
-	PyObject *args = NULL;
-	PyObject *mod = NULL;
+	PyObject *dict = NULL;
 	PyObject *ret = NULL;
+	size_t i;
 
-	obIID = Py_nsIID::PyObjectFromIID(iid);
+	if (g_obComponentClass==NULL && !InitComponentFactory())
+		goto done;
+	obIID = GetSharedIIDObject(iid);
 	if (obIID==NULL)
 		goto done;
-
-	if (g_obFuncMakeInterfaceCount==NULL) {
-		PyObject *mod = PyImport_ImportModule("xpcom.client");
-		if (mod) 
-			g_obFuncMakeInterfaceCount = PyObject_GetAttrString(mod, "MakeInterfaceResult");
-		Py_XDECREF(mod);
+	{
+	PyObject *hook = PyDict_GetItem(g_obClientDict, g_obMakeResultName); // borrowed
+	if (hook && hook != g_obDefaultMakeResult) {
+		ret = PyObject_CallFunctionObjArgs(hook, pyis, obIID, NULL);
+		goto done;
 	}
-	if (g_obFuncMakeInterfaceCount==NULL) goto done;
-
-	args = Py_BuildValue("OO", pyis, obIID);
-	if (args==NULL) goto done;
-	ret = PyEval_CallObject(g_obFuncMakeInterfaceCount, args);
+	}
+	dict = PyDict_Copy(g_obComponentTemplate);
+	if (dict==NULL)
+		goto done;
+	if (PyDict_SetItem(dict, g_obComObjName, pyis) != 0 ||
+	    PyDict_SetItem(dict, g_obPendingIIDName, obIID) != 0)
+		goto done;
+	for (i = 0; i < NUM_COMPONENT_DICTS; i++) {
+		PyObject *sub = PyDict_New();
+		if (sub==NULL)
+			goto done;
+		int rc = PyDict_SetItem(dict, g_obComponentDictNames[i], sub);
+		Py_DECREF(sub);
+		if (rc != 0)
+			goto done;
+	}
+	ret = PyInstance_NewRaw(g_obComponentClass, dict);
 done:
 	if (PyErr_Occurred()) {
 		NS_ABORT_IF_FALSE(ret==NULL, "Have an error, but also a return val!");
 		PyXPCOM_LogError("Creating an interface object to be used as a result failed\n");
 		PyErr_Clear();
 	}
-	Py_XDECREF(mod);
-	Py_XDECREF(args);
+	Py_XDECREF(dict);
 	Py_XDECREF(obIID);
 	if (ret==NULL) // eek - error - return the original with no refcount mod.
 		ret = pyis; 
@@ -512,4 +788,4 @@ Py_nsISupports::methods[] =
 }
 
 NS_EXPORT_STATIC_MEMBER_(PyXPCOM_TypeObject *) Py_nsISupports::type = NULL;
-NS_EXPORT_STATIC_MEMBER_(PyObject *) Py_nsISupports::mapIIDToType = NULL;
+NS_EXPORT_STATIC_MEMBER_(Py_nsISupports::TypeMap *) Py_nsISupports::mapIIDToType = NULL;
@@ -0,0 +1,386 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1/GPL 2.0/LGPL 2.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the Python XPCOM language bindings.
+ *
+ * The Initial Developer of the Original Code is
+ * ActiveState Tool Corp.
+ * Portions created by the Initial Developer are Copyright (C) 2000
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Mark Hammond <MarkH@ActiveState.com> (original author)
+ *
+ * Alternatively, the contents of this file may be used under the terms of
+ * either the GNU General Public License Version 2 or later (the "GPL"), or
+ * the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+ * in which case the provisions of the GPL or the LGPL are applicable instead
+ * of those above. If you wish to allow use of your version of this file only
+ * under the terms of either the GPL or the LGPL, and not to allow others to
+ * use your version of this file under the terms of the MPL, indicate your
+ * decision by deleting the provisions above and replace them with the notice
+ * and other provisions required by the GPL or the LGPL. If you do not delete
+ * the provisions above, a recipient may use your version of this file under
+ * the terms of any one of the MPL, the GPL or the LGPL.
+ *
+ * ***** END LICENSE BLOCK ***** */
+
+// PyMethodSignature.cpp -- pre-processed method type descriptors
+//
+// This code is part of the XPCOM extensions for Python.
+//
+// The client side of the bindings describes each parameter of a method
+// with a tuple (see xpcom/client/__init__.py _MakeMethodSpec).  Parsing
+// and validating those tuples on every call is a significant part of
+// the cost of a call, so the client builds one of these objects per
+// method and hands it to NS_InvokeBySignature instead.
+//
+// PyXPCOM_Method wraps a signature up as the callable the client binds
+// to its interface objects, so building a method needs no generated code.
+
+#include "PyXPCOM_std.h"
+
+// @pymethod <o PyXPCOM_MethodSignature>|xpcom|MakeMethodSignature|Creates a compiled method signature
+PyObject *PyXPCOMMethod_MakeMethodSignature(PyObject *self, PyObject *args)
+{
+	PyObject *obIID, *obTypeDescs;
+	int methodIndex;
+	// @pyparm <o Py_nsIID>|iid||The IID of the interface the method belongs to.
+	// @pyparm int|methodIndex||The index of the method in the interface.
+	// @pyparm sequence|typeDescs||The type descriptors for all params,
+	// including hidden ones.
+	if (!PyArg_ParseTuple(args, "OiO:MakeMethodSignature",
+	                      &obIID, &methodIndex, &obTypeDescs))
+		return NULL;
+	nsIID iid;
+	if (!Py_nsIID::IIDFromPyObject(obIID, &iid))
+		return NULL;
+	PyXPCOM_MethodSignature *ret = new PyXPCOM_MethodSignature(iid, methodIndex);
+	if (!ret)
+		return PyErr_NoMemory();
+	if (!ret->Init(obTypeDescs)) {
+		Py_DECREF(ret);
+		return NULL;
+	}
+	return ret;
+}
+
+// @object PyXPCOM_MethodSignature|The pre-processed type information for
+// a single method, suitable for passing to <om xpcom.NS_InvokeBySignature>.
+PyTypeObject PyXPCOM_MethodSignature::type =
+{
+	PyObject_HEAD_INIT(&PyType_Type)
+	0,
+	"MethodSignature",
+	sizeof(PyXPCOM_MethodSignature),
+	0,
+	PyTypeMethod_dealloc,                           /* tp_dealloc */
+	0,                                              /* tp_print */
+	PyTypeMethod_getattr,                           /* tp_getattr */
+	0,                                              /* tp_setattr */
+	0,                                              /* tp_compare */
+	PyTypeMethod_repr,                              /* tp_repr */
+};
+
+PyXPCOM_MethodSignature::PyXPCOM_MethodSignature(const nsIID &iid,
+                                                 int methodIndex)
+{
+	ob_type = &type;
+	_Py_NewReference(this);
+	m_iid = iid;
+	m_methodIndex = methodIndex;
+	m_min_num_params = m_max_num_params = 0;
+}
+
+bool
+PyXPCOM_MethodSignature::Init(PyObject *typedescs)
+{
+	return PyXPCOM_ParseTypeDescriptors(typedescs, mPyTypeDesc,
+	                                    &m_min_num_params,
+	                                    &m_max_num_params);
+}
+
+/*static*/PyObject *
+PyXPCOM_MethodSignature::PyTypeMethod_getattr(PyObject *self, char *name)
+{
+	PyXPCOM_MethodSignature *me = (PyXPCOM_MethodSignature *)self;
+	if (strcmp(name, "iid")==0)
+		return Py_nsIID::PyObjectFromIID(me->m_iid);
+	if (strcmp(name, "method_index")==0)
+		return PyInt_FromLong(me->m_methodIndex);
+	if (strcmp(name, "min_args")==0)
+		return PyInt_FromLong(me->m_min_num_params);
+	if (strcmp(name, "max_args")==0)
+		return PyInt_FromLong(me->m_max_num_params);
+	return PyErr_Format(PyExc_AttributeError,
+	                    "MethodSignature objects have no attribute '%s'", name);
+}
+
+/* static */ PyObject *
+PyXPCOM_MethodSignature::PyTypeMethod_repr(PyObject *self)
+{
+	PyXPCOM_MethodSignature *me = (PyXPCOM_MethodSignature *)self;
+	char buf[256];
+	char idstr[NSID_LENGTH];
+	me->m_iid.ToProvidedString(idstr);
+	sprintf(buf, "<MethodSignature %s:%d (%d-%d args)>", idstr,
+	        me->m_methodIndex, me->m_min_num_params, me->m_max_num_params);
+	return PyString_FromString(buf);
+}
+
+/*static*/ void
+PyXPCOM_MethodSignature::PyTypeMethod_dealloc(PyObject *ob)
+{
+	delete (PyXPCOM_MethodSignature *)ob;
+}
+
+// @pymethod <o PyXPCOM_Method>|xpcom|MakeMethod|Creates a callable for a
+// method of an interface.
+PyObject *PyXPCOMMethod_MakeMethod(PyObject *self, PyObject *args)
+{
+	PyObject *obName, *obSignature, *obArgNames;
+	int numRequired;
+	// @pyparm string|name||The name of the method.
+	// @pyparm <o PyXPCOM_MethodSignature>|signature||The signature of the method.
+	// @pyparm (string, ...)|argNames||The names of the args the method accepts.
+	// @pyparm int|numRequired||The number of args which have no default.
+	if (!PyArg_ParseTuple(args, "O!O!O!i:MakeMethod",
+	                      &PyString_Type, &obName,
+	                      &PyXPCOM_MethodSignature::type, &obSignature,
+	                      &PyTuple_Type, &obArgNames,
+	                      &numRequired))
+		return NULL;
+	if (numRequired < 0 || numRequired > PyTuple_GET_SIZE(obArgNames)) {
+		PyErr_Format(PyExc_ValueError,
+		             "%d required args is invalid for a method with %d args",
+		             numRequired, (int)PyTuple_GET_SIZE(obArgNames));
+		return NULL;
+	}
+	PyXPCOM_Method *ret = new PyXPCOM_Method(obName,
+	                                         (PyXPCOM_MethodSignature *)obSignature,
+	                                         obArgNames, numRequired);
+	if (!ret)
+		return PyErr_NoMemory();
+	return ret;
+}
+
+// @object PyXPCOM_Method|A method of an XPCOM interface, as used by
+// xpcom.client.  Calling it with the interface object and the method's args
+// calls the method via <om xpcom.NS_InvokeBySignature>.
+PyTypeObject PyXPCOM_Method::type =
+{
+	PyObject_HEAD_INIT(&PyType_Type)
+	0,
+	"XPCOMMethod",
+	sizeof(PyXPCOM_Method),
+	0,
+	PyTypeMethod_dealloc,                           /* tp_dealloc */
+	0,                                              /* tp_print */
+	PyTypeMethod_getattr,                           /* tp_getattr */
+	0,                                              /* tp_setattr */
+	0,                                              /* tp_compare */
+	PyTypeMethod_repr,                              /* tp_repr */
+	0,                                              /* tp_as_number */
+	0,                                              /* tp_as_sequence */
+	0,                                              /* tp_as_mapping */
+	0,                                              /* tp_hash */
+	PyTypeMethod_call,                              /* tp_call */
+};
+
+PyXPCOM_Method::PyXPCOM_Method(PyObject *name,
+                               PyXPCOM_MethodSignature *signature,
+                               PyObject *argNames, int numRequired)
+{
+	ob_type = &type;
+	_Py_NewReference(this);
+	m_name = name;
+	Py_INCREF(m_name);
+	m_signature = signature;
+	Py_INCREF(m_signature);
+	m_argNames = argNames;
+	Py_INCREF(m_argNames);
+	m_numRequired = numRequired;
+}
+
+PyXPCOM_Method::~PyXPCOM_Method()
+{
+	Py_DECREF(m_name);
+	Py_DECREF(m_signature);
+	Py_DECREF(m_argNames);
+}
+
+// Raise the same TypeError Python does for a function called with the
+// wrong number of args (counting the interface object as the first).
+static PyObject *
+RaiseArgCountError(PyXPCOM_Method *me, int numGiven)
+{
+	int numArgs = (int)PyTuple_GET_SIZE(me->m_argNames);
+	int numExpected;
+	const char *qualifier;
+	if (me->m_numRequired == numArgs) {
+		qualifier = "exactly";
+		numExpected = numArgs;
+	} else if (numGiven > numArgs) {
+		qualifier = "at most";
+		numExpected = numArgs;
+	} else {
+		qualifier = "at least";
+		numExpected = me->m_numRequired;
+	}
+	// +1 for the interface object.
+	return PyErr_Format(PyExc_TypeError,
+	                    "%s() takes %s %d argument%s (%d given)",
+	                    PyString_AS_STRING(me->m_name), qualifier,
+	                    numExpected + 1, numExpected == 0 ? "" : "s",
+	                    numGiven + 1);
+}
+
+// Build the tuple of args for the signature from the positional and keyword
+// args to the call, filling in None for any defaulted args not supplied.
+static PyObject *
+BuildCallArgs(PyXPCOM_Method *me, PyObject *args, PyObject *kw)
+{
+	int numGiven = (int)PyTuple_GET_SIZE(args) - 1;
+	int numArgs = (int)PyTuple_GET_SIZE(me->m_argNames);
+	int numKeywords = kw ? (int)PyDict_Size(kw) : 0;
+	if (numGiven > numArgs)
+		return RaiseArgCountError(me, numGiven + numKeywords);
+
+	PyObject *ret = PyTuple_New(numArgs);
+	if (!ret)
+		return NULL;
+	int i;
+	for (i = 0; i < numGiven; i++) {
+		PyObject *ob = PyTuple_GET_ITEM(args, i + 1);
+		Py_INCREF(ob);
+		PyTuple_SET_ITEM(ret, i, ob);
+	}
+	int numKeywordsUsed = 0;
+	for (; i < numArgs; i++) {
+		PyObject *ob = NULL;
+		if (numKeywords) {
+			ob = PyDict_GetItem(kw, PyTuple_GET_ITEM(me->m_argNames, i));
+			if (ob)
+				numKeywordsUsed++;
+		}
+		if (!ob) {
+			if (i < me->m_numRequired) {
+				Py_DECREF(ret);
+				return RaiseArgCountError(me, numGiven + numKeywordsUsed);
+			}
+			ob = Py_None;
+		}
+		Py_INCREF(ob);
+		PyTuple_SET_ITEM(ret, i, ob);
+	}
+	if (numKeywordsUsed == numKeywords)
+		return ret;
+
+	// Some keyword didn't name a defaulted arg - work out which.
+	Py_DECREF(ret);
+	PyObject *key, *value;
+	Py_ssize_t pos = 0;
+	while (PyDict_Next(kw, &pos, &key, &value)) {
+		for (i = 0; i < numArgs; i++) {
+			int cmp = PyObject_RichCompareBool(key,
+			                                   PyTuple_GET_ITEM(me->m_argNames, i),
+			                                   Py_EQ);
+			if (cmp < 0)
+				return NULL;
+			if (cmp)
+				break;
+		}
+		if (i >= numArgs) {
+			PyObject *obKey = PyObject_Str(key);
+			if (obKey) {
+				PyErr_Format(PyExc_TypeError,
+				             "%s() got an unexpected keyword argument '%s'",
+				             PyString_AS_STRING(me->m_name),
+				             PyString_AS_STRING(obKey));
+				Py_DECREF(obKey);
+			}
+			return NULL;
+		}
+		if (i < numGiven) {
+			PyErr_Format(PyExc_TypeError,
+			             "%s() got multiple values for keyword argument '%s'",
+			             PyString_AS_STRING(me->m_name),
+			             PyString_AS_STRING(PyTuple_GET_ITEM(me->m_argNames, i)));
+			return NULL;
+		}
+	}
+	// Only reached if a keyword isn't equal to itself.
+	PyErr_SetString(PyExc_TypeError, "invalid keyword arguments");
+	return NULL;
+}
+
+/*static*/PyObject *
+PyXPCOM_Method::PyTypeMethod_call(PyObject *self, PyObject *args, PyObject *kw)
+{
+	PyXPCOM_Method *me = (PyXPCOM_Method *)self;
+	if (PyTuple_GET_SIZE(args) < 1) {
+		PyErr_Format(PyExc_TypeError,
+		             "unbound method %s() must be called with an XPCOM "
+		             "interface as first argument",
+		             PyString_AS_STRING(me->m_name));
+		return NULL;
+	}
+	PyObject *obIS = PyObject_GetAttrString(PyTuple_GET_ITEM(args, 0),
+	                                        "_comobj_");
+	if (!obIS)
+		return NULL;
+	PyObject *ret = NULL;
+	PyObject *obArgs = BuildCallArgs(me, args, kw);
+	if (obArgs) {
+		ret = PyXPCOM_InvokeBySignature(obIS, me->m_signature, obArgs);
+		Py_DECREF(obArgs);
+	}
+	Py_DECREF(obIS);
+	return ret;
+}
+
+/*static*/PyObject *
+PyXPCOM_Method::PyTypeMethod_getattr(PyObject *self, char *name)
+{
+	PyXPCOM_Method *me = (PyXPCOM_Method *)self;
+	if (strcmp(name, "__name__")==0) {
+		Py_INCREF(me->m_name);
+		return me->m_name;
+	}
+	if (strcmp(name, "signature")==0) {
+		Py_INCREF(me->m_signature);
+		return me->m_signature;
+	}
+	if (strcmp(name, "arg_names")==0) {
+		Py_INCREF(me->m_argNames);
+		return me->m_argNames;
+	}
+	if (strcmp(name, "num_required")==0)
+		return PyInt_FromLong(me->m_numRequired);
+	return PyErr_Format(PyExc_AttributeError,
+	                    "XPCOMMethod objects have no attribute '%s'", name);
+}
+
+/* static */ PyObject *
+PyXPCOM_Method::PyTypeMethod_repr(PyObject *self)
+{
+	PyXPCOM_Method *me = (PyXPCOM_Method *)self;
+	return PyString_FromFormat("<XPCOMMethod %s>",
+	                           PyString_AS_STRING(me->m_name));
+}
+
+/*static*/ void
+PyXPCOM_Method::PyTypeMethod_dealloc(PyObject *ob)
+{
+	delete (PyXPCOM_Method *)ob;
+}
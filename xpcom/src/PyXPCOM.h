@@ -50,6 +50,7 @@
 #define __PYXPCOM_H__
 
 #include "mozilla/mozalloc.h"
+#include "mozilla/Atomics.h"
 #include "nsMemory.h"
 #include "nsIWeakReference.h"
 #include "nsIInterfaceInfo.h"
@@ -64,6 +65,8 @@
 #include "nsIVariant.h"
 #include "nsIModule.h"
 #include "nsServiceManagerUtils.h"
+#include "nsDataHashtable.h"
+#include "nsHashKeys.h"
 #include "nsStringAPI.h"
 
 #include "nsCRT.h"
@@ -237,6 +240,7 @@ public:
 	static PyObject *Py_getattr(PyObject *self, char *name);
 	static int Py_setattr(PyObject *op, char *name, PyObject *v);
 	static int Py_cmp(PyObject *ob1, PyObject *ob2);
+	static PyObject *Py_richcmp(PyObject *ob1, PyObject *ob2, int op);
 	static long Py_hash(PyObject *self);
 };
 
@@ -265,8 +269,15 @@ public:
 	}
 	// Get the nsISupports interface from the PyObject WITH NO REF COUNT ADDED
 	static nsISupports *GetI(PyObject *self, nsIID *ret_iid = NULL);
+	// Get the object's canonical nsISupports (ie, its XPCOM identity),
+	// again with no reference added.  This is queried for once, then
+	// remembered.
+	static nsISupports *GetIdentity(PyObject *self);
 	nsCOMPtr<nsISupports> m_obj;
 	nsIID m_iid;
+	// The canonical nsISupports once GetIdentity() has found it - not
+	// a reference, as m_obj keeps the object alive.
+	nsISupports *m_pIdentity;
 
 	// Given an nsISupports and an Interface ID, create and return an object
 	// Does not QI the object - the caller must ensure the nsISupports object
@@ -314,7 +325,9 @@ public:
 	// Internal (sort-of) objects.
 	static NS_EXPORT_STATIC_MEMBER_(PyXPCOM_TypeObject) *type;
 	static NS_EXPORT_STATIC_MEMBER_(PyMethodDef) methods[];
-	static PyObject *mapIIDToType;
+	// The type to use for each IID, as registered by RegisterInterface.
+	typedef nsDataHashtable<nsIDHashKey, PyTypeObject *> TypeMap;
+	static TypeMap *mapIIDToType;
 	static void SafeRelease(Py_nsISupports *ob);
 	static void RegisterInterface( const nsIID &iid, PyTypeObject *t);
 	static void InitType();
@@ -385,14 +398,94 @@ public:
 };
 
 
+/**
+ * Per-thread scratch space for buffers that only need to live for the
+ * duration of a single call (i.e. 'in' params which the callee never takes
+ * ownership of).  Allocations are bumped off a fixed slab; each user
+ * remembers the mark when it started and rolls back to it when done.  As
+ * calls on a single thread are strictly nested, re-entrant calls simply
+ * stack on top of each other.  Requests that don't fit return NULL, and the
+ * caller should fall back to the heap.
+ */
+class PyXPCOM_CallArena {
+public:
+	// Get the arena for the current thread; the GIL must be held.
+	static PyXPCOM_CallArena *GetForThread();
+
+	PyXPCOM_CallArena() : mUsed(0) {}
+	void *Alloc(size_t size, size_t count) {
+		if (size == 0 || count > (kSlabSize - mUsed) / size)
+			return nullptr;
+		size_t bytes = (size * count + kAlign - 1) & ~(kAlign - 1);
+		if (bytes > kSlabSize - mUsed)
+			return nullptr;
+		void *result = mSlab.bytes + mUsed;
+		mUsed += bytes;
+		memset(result, 0, bytes);
+		return result;
+	}
+	bool Owns(const void *p) const {
+		return p >= mSlab.bytes && p < mSlab.bytes + kSlabSize;
+	}
+	size_t Mark() const { return mUsed; }
+	void Reset(size_t mark) {
+		MOZ_ASSERT(mark <= mUsed, "Call arena released out of order");
+		mUsed = mark;
+	}
+private:
+	static const size_t kSlabSize = 4096;
+	static const size_t kAlign = 8;
+	union {
+		char bytes[kSlabSize];
+		double align_d;
+		void *align_p;
+	} mSlab;
+	size_t mUsed;
+};
+
 /**
  * Helper class for leak tracking
  * Pretty much debug-only
+ * Sub-classes may also call UseCallArena() to have AllocTransient() hand out
+ * memory from the per-thread call arena; any such memory is released when
+ * the helper is destroyed.
  */
 class PyXPCOM_AllocHelper {
 protected:
+	void UseCallArena() {
+		MOZ_ASSERT(!mArena, "Already using the call arena");
+		mArena = PyXPCOM_CallArena::GetForThread();
+		if (mArena)
+			mArenaMark = mArena->Mark();
+	}
+	MOZ_ALWAYS_INLINE bool IsArenaMemory(const void *buf) const {
+		return mArena && mArena->Owns(buf);
+	}
+	// Allocate memory that is only needed until this helper is destroyed.
+	// Must not be used for anything the callee may free or reallocate.
+	void* AllocTransient(size_t size, size_t count, const char* file, const unsigned line) {
+		void *result = mArena ? mArena->Alloc(size, count) : nullptr;
+		if (!result)
+			return Alloc(size, count, file, line);
+		MarkAlloc(result, file, line);
+		return result;
+	}
+	// Only suitable for types with trivial destructors
+	template<typename T>
+	T* AllocTransient(T*& dest, size_t count, const char* file, const unsigned line) {
+		dest = reinterpret_cast<T*>(mArena ? mArena->Alloc(sizeof(T), count) : nullptr);
+		if (!dest)
+			return Alloc(dest, count, file, line);
+		MarkAlloc(dest, file, line);
+		for (size_t i = 0; i < count; ++i)
+			new (&dest[i]) T();
+		return dest;
+	}
+	PyXPCOM_CallArena *mArena;
+	size_t mArenaMark;
+
 	#ifdef DEBUG
-	PyXPCOM_AllocHelper() {
+	PyXPCOM_AllocHelper() : mArena(nullptr), mArenaMark(0) {
 		mAllocations.Init();
 	}
 	~PyXPCOM_AllocHelper();
@@ -412,6 +505,11 @@ protected:
 	MOZ_ALWAYS_INLINE void MarkFree(void* buf);
 	static PLDHashOperator ReadAllocation(void* key, LineRef* value, void* userData);
 	#else
+	PyXPCOM_AllocHelper() : mArena(nullptr), mArenaMark(0) {}
+	~PyXPCOM_AllocHelper() {
+		if (mArena)
+			mArena->Reset(mArenaMark);
+	}
 	template<typename T>
 	MOZ_ALWAYS_INLINE T* Alloc(T*& dest, size_t count, const char*, const unsigned) {
 		dest = reinterpret_cast<T*>(moz_calloc(sizeof(T), count));
@@ -425,10 +523,12 @@ protected:
 	MOZ_ALWAYS_INLINE void MarkAlloc(void*, const char*, const unsigned) {}
 	template<typename T>
 	MOZ_ALWAYS_INLINE void Free(T* buf) {
-		delete[] buf;
+		if (!IsArenaMemory(buf))
+			delete[] buf;
 	}
 	MOZ_ALWAYS_INLINE void Free(void* buf) {
-		moz_free(buf);
+		if (!IsArenaMemory(buf))
+			moz_free(buf);
 	}
 	MOZ_ALWAYS_INLINE void MarkFree(void* buf) {}
 	#endif
@@ -530,11 +630,119 @@ public:
 	#endif
 };
 
+// Parse a Python sequence of type descriptor tuples (as built by
+// xpcom/client/__init__.py) into |descs|, validate them, and compute the
+// range of Python args a call using them accepts.
+bool PyXPCOM_ParseTypeDescriptors(PyObject *typedescs,
+                                  nsTArray<PythonTypeDescriptor> &descs,
+                                  int *min_num_params, int *max_num_params);
+
+// ------------------------------------------------------------------------
+// PyXPCOM_MethodSignature - a "compiled" set of type descriptors
+// ------------------------------------------------------------------------
+// The client code creates one of these per (IID, method index) and passes
+// it to NS_InvokeBySignature on every call, so the descriptors are only
+// parsed and checked once instead of on every invocation.
+class PYXPCOM_EXPORT PyXPCOM_MethodSignature : public PyObject
+{
+public:
+	PyXPCOM_MethodSignature(const nsIID &iid, int methodIndex);
+	bool Init(PyObject *typedescs);
+
+	nsIID m_iid;
+	int m_methodIndex;
+	int m_min_num_params;
+	int m_max_num_params;
+	nsTArray<PythonTypeDescriptor> mPyTypeDesc;
+
+	static bool Check(PyObject *ob) {
+		return ob && ob->ob_type == &type;
+	}
+	/* Python support */
+	static PyObject *PyTypeMethod_getattr(PyObject *self, char *name);
+	static PyObject *PyTypeMethod_repr(PyObject *self);
+	static void PyTypeMethod_dealloc(PyObject *self);
+	static NS_EXPORT_STATIC_MEMBER_(PyTypeObject) type;
+};
+
+// Call the method described by signature on the native wrapper obIS.
+// (XPCOMFunctions.cpp)
+PyObject *PyXPCOM_InvokeBySignature(PyObject *obIS,
+                                    PyXPCOM_MethodSignature *signature,
+                                    PyObject *obArgs);
+
+// ------------------------------------------------------------------------
+// PyXPCOM_Method - a method of an xpcom.client interface
+// ------------------------------------------------------------------------
+// The client creates one of these per (IID, method) instead of generating
+// a Python function for it.  It is bound to xpcom.client._Interface
+// objects like a function, so is called with the interface object followed
+// by the method's args.  Missing optional args are passed as None.
+class PYXPCOM_EXPORT PyXPCOM_Method : public PyObject
+{
+public:
+	PyXPCOM_Method(PyObject *name, PyXPCOM_MethodSignature *signature,
+	               PyObject *argNames, int numRequired);
+	~PyXPCOM_Method();
+
+	PyObject *m_name;
+	PyXPCOM_MethodSignature *m_signature;
+	PyObject *m_argNames; // A tuple of the names of the args.
+	int m_numRequired;
+
+	/* Python support */
+	static PyObject *PyTypeMethod_call(PyObject *self, PyObject *args, PyObject *kw);
+	static PyObject *PyTypeMethod_getattr(PyObject *self, char *name);
+	static PyObject *PyTypeMethod_repr(PyObject *self);
+	static void PyTypeMethod_dealloc(PyObject *self);
+	static NS_EXPORT_STATIC_MEMBER_(PyTypeObject) type;
+};
+
+// ------------------------------------------------------------------------
+// PyXPCOM_ArrayResult - a numeric array result, not unpacked into a list
+// ------------------------------------------------------------------------
+// Takes ownership of the (nsMemory allocated) array it is given.  Only
+// used once enabled via PyXPCOM_SetBufferArrayResults().
+class PYXPCOM_EXPORT PyXPCOM_ArrayResult : public PyObject
+{
+public:
+	PyXPCOM_ArrayResult(void *data, PRUint32 count, PRUint32 element_size,
+	                    XPTTypeDescriptorTags array_type);
+	~PyXPCOM_ArrayResult();
+	// Should an array of this type be returned as one of these?
+	static bool CanAdopt(XPTTypeDescriptorTags array_type);
+
+	void *m_data;
+	PRUint32 m_count;
+	PRUint32 m_itemsize;
+	XPTTypeDescriptorTags m_type;
+	Py_ssize_t m_shape; // for the buffer interface.
+
+	static bool Check(PyObject *ob) {
+		return ob && ob->ob_type == &type;
+	}
+	/* Python support */
+	static Py_ssize_t PyTypeMethod_length(PyObject *self);
+	static PyObject *PyTypeMethod_item(PyObject *self, Py_ssize_t index);
+	static Py_ssize_t PyTypeMethod_getreadbuffer(PyObject *self, Py_ssize_t segment, void **ptr);
+	static Py_ssize_t PyTypeMethod_getsegcount(PyObject *self, Py_ssize_t *lenp);
+	static int PyTypeMethod_getbuffer(PyObject *self, Py_buffer *view, int flags);
+	static PyObject *PyTypeMethod_getattr(PyObject *self, char *name);
+	static PyObject *PyTypeMethod_repr(PyObject *self);
+	static void PyTypeMethod_dealloc(PyObject *self);
+	static NS_EXPORT_STATIC_MEMBER_(PyTypeObject) type;
+};
+// Turn buffer array results on or off, returning the previous setting.
+bool PyXPCOM_SetBufferArrayResults(bool bEnable);
+
 class PyXPCOM_InterfaceVariantHelper : public PyXPCOM_AllocHelper {
 public:
 	PyXPCOM_InterfaceVariantHelper(Py_nsISupports *parent);
 	~PyXPCOM_InterfaceVariantHelper();
 	bool Init(PyObject *obParams);
+	// Set up the call using pre-processed type descriptors; |obArgs| is
+	// the sequence of actual (non-hidden) arguments.
+	bool Init(PyXPCOM_MethodSignature *signature, PyObject *obArgs);
 	/**
 	 * Prepare for the call; this converts the params, etc.
 	 */
@@ -545,6 +753,22 @@ public:
 	// The array of variants to pass to XPTCall
 	nsAutoTArray<nsXPTCVariant, 8> mDispatchParams;
 protected:
+	bool InitDispatchParams(int min_num_params, int max_num_params);
+	// Allocate the buffer for an 'in' param.  Pure 'in' buffers are never
+	// owned by the callee, so can come from the call arena; 'inout' ones
+	// may be freed or replaced by the callee so must be on the heap.
+	template<typename T> MOZ_ALWAYS_INLINE
+	T* AllocInParam(T*& dest, size_t count, const PythonTypeDescriptor &td,
+	                const char* file, const unsigned line) {
+		return td.IsOut() ? Alloc(dest, count, file, line)
+		                  : AllocTransient(dest, count, file, line);
+	}
+	MOZ_ALWAYS_INLINE
+	void* AllocInParam(size_t size, size_t count, const PythonTypeDescriptor &td,
+	                   const char* file, const unsigned line) {
+		return td.IsOut() ? Alloc(size, count, file, line)
+		                  : AllocTransient(size, count, file, line);
+	}
 	PyObject *MakeSinglePythonResult(int index);
 	/**
 	 * Fill in a single variant value
@@ -615,6 +839,46 @@ public:
 
 NS_DEFINE_STATIC_IID_ACCESSOR(nsIInternalPython, NS_IINTERNALPYTHON_IID)
 
+// The XPTC stubs of the gateways sharing an identity (ie, with the same
+// base object), keyed by IID.  This is an open-addressing table which
+// can be read without any lock.  Entries are only ever added to empty
+// slots (or dead ones for the same IID) and removed by marking them dead,
+// so a slot never changes IID under a reader.  Writers (which must hold
+// the base object's lock) replace the whole array when it fills, keeping
+// the old ones around for readers still using them until the table dies.
+// As dead slots are kept and reused, the table only grows with the
+// number of distinct IIDs, which bounds the arrays kept.
+class PyXPCOM_StubTable {
+public:
+	PyXPCOM_StubTable() : mSlots(nullptr) {}
+	~PyXPCOM_StubTable();
+	// Returns NULL if there is no stub for the IID.
+	void *Lookup(const nsIID &iid);
+	void Add(const nsIID &iid, void *stub);
+	void Remove(const nsIID &iid, void *stub);
+private:
+	struct Slot {
+		nsIID iid;
+		mozilla::Atomic<void *, mozilla::ReleaseAcquire> stub;
+	};
+	struct Slots {
+		Slots(PRUint32 aCapacity, Slots *aRetired)
+			: capacity(aCapacity), used(0), retired(aRetired),
+			  slot(new Slot[aCapacity]) {}
+		~Slots() {
+			delete [] slot;
+			delete retired;
+		}
+		PRUint32 capacity; // always a power of 2
+		PRUint32 used;     // including dead slots
+		Slots *retired;    // the arrays we replaced
+		Slot *slot;
+	};
+	static void Insert(Slots *slots, const nsIID &iid, void *stub);
+	static bool Revive(Slots *slots, const nsIID &iid, void *stub);
+	mozilla::Atomic<Slots *, mozilla::ReleaseAcquire> mSlots;
+};
+
 // This is roughly equivalent to PyGatewayBase in win32com
 //
 class PyG_Base : public nsIInternalPython, public nsISupportsWeakReference
@@ -623,6 +887,8 @@ public:
 	NS_DECL_THREADSAFE_ISUPPORTS
 	NS_DECL_NSISUPPORTSWEAKREFERENCE
 	PyObject *UnwrapPythonObject(void);
+	// For our weak reference - see PyXPCOM_GatewayWeakReference::QueryReferent
+	bool AddRefIfAlive(void);
 
 	// A static "constructor" - the real ctor is protected.
 	static nsresult CreateNew(PyObject *pPyInstance, 
@@ -661,6 +927,9 @@ public:
 	// This means that once we have created it (and while we
 	// are alive) it will never die.
 	nsCOMPtr<nsIWeakReference> m_pWeakRef;
+	// Set when the policy is happy for nsIVariant params to be
+	// converted to their values natively (_com_native_variants_)
+	bool m_bNativeVariants;
 #ifdef NS_BUILD_REFCNT_LOGGING
 	char refcntLogRepr[64]; // sigh - I wish I knew how to use the Moz string classes :(  OK for debug only tho.
 #endif
@@ -668,6 +937,17 @@ protected:
 	PyG_Base(PyObject *instance, const nsIID &iid);
 	virtual ~PyG_Base();
 	PyG_Base *m_pBaseObject; // A chain to implement identity rules.
+	// This is used to make sure QIing to the same interface returns the
+	// same pointer; necessary to match xpconnect semantics.  Only used
+	// on the base object, and holds all the other stubs for it.
+	PyXPCOM_StubTable m_stubs;
+	friend class PyXPCOM_XPTStub; // Adds itself to the base's m_stubs.
+	// Is the interface param described by piid or (methodIndex, d) an
+	// nsIVariant?  Must hold the GIL.
+	bool IsVariantParam(const nsIID *piid, int methodIndex,
+	                    const XPTParamDescriptor *d);
+	// Info for m_iid, fetched by IsVariantParam when first needed.
+	nsCOMPtr<nsIInterfaceInfo> m_pInterfaceInfo;
 	nsresult InvokeNativeViaPolicy(	const char *szMethodName,
 			PyObject **ppResult = NULL,
 			const char *szFormat = NULL,
@@ -679,6 +959,9 @@ protected:
 			va_list va);
 };
 
+class PyXPCOM_CallBatch;
+class PyXPCOM_GatewayVariantHelper;
+
 class PyXPCOM_XPTStub : public PyG_Base, public nsAutoXPTCStub
 {
 friend class PyG_Base;
@@ -694,13 +977,27 @@ public:
                           nsXPTCMiniVariant* params);
 
 	virtual void *ThisAsIID(const nsIID &iid);
+
+	// Deliver any calls queued in batching mode to the policy's
+	// _CallMethodBatch_ in a single hold of the GIL.
+	void FlushBatch();
 protected:
 	PyXPCOM_XPTStub(PyObject *instance, const nsIID &iid);
 	~PyXPCOM_XPTStub();
 	
-	// This is used to make sure QIing to the same interface returns the
-	// same pointer; necessary to match xpconnect semantics.
-	PyXPCOM_XPTStub* m_pNextObject;
+	// Only set when the policy asks for batching (_com_batch_calls_)
+	PyXPCOM_CallBatch* m_pBatch;
+
+	// The policy's native dispatch table (see _GetDispatchTable_), loaded
+	// on the first call.  m_pDispatchTable is a tuple indexed by method
+	// index, of (kind, name) or None for calls which go via _CallMethod_.
+	PyObject *GetDispatchEntry(PRUint16 methodIndex);
+	void LoadDispatchTable();
+	nsresult CallDispatchEntry(PyObject *entry, PyObject *obParams,
+	                           PyXPCOM_GatewayVariantHelper &arg_helper);
+	bool m_bDispatchTableLoaded;
+	PyObject *m_pDispatchTarget;
+	PyObject *m_pDispatchTable;
 private:
 };
 
@@ -737,6 +1034,9 @@ public:
 	NS_DECL_NSIWEAKREFERENCE
 	virtual size_t SizeOfOnlyThis(mozilla::MallocSizeOf aMallocSizeOf) const;
 	PyG_Base *m_pBase; // NO REF COUNT!!!
+	// The key for the object lock guarding m_pBase - the gateway's
+	// address, which remains valid as a key after the gateway dies.
+	const void *m_lockKey;
 #ifdef NS_BUILD_REFCNT_LOGGING
 	char refcntLogRepr[41];
 #endif
@@ -756,6 +1056,7 @@ public:
 	~PyXPCOM_GatewayVariantHelper();
 	PyObject *MakePyArgs();
 	nsresult ProcessPythonResult(PyObject *ob);
+	nsresult ProcessUserResult(PyObject *user_result);
 	PyG_Base *m_gateway;
 private:
 	nsresult BackFillVariant( PyObject *ob, int index);
@@ -801,6 +1102,21 @@ PyObject *PyObject_FromXPTTypeDescriptor( const XPTTypeDescriptor *d);
 PyObject *PyObject_FromXPTParamDescriptor( const XPTParamDescriptor *d);
 PyObject *PyObject_FromXPTMethodDescriptor( const XPTMethodDescriptor *d);
 PyObject *PyObject_FromXPTConstant( const XPTConstDescriptor *d);
+// As PyObject_FromXPTMethodDescriptor, but the tuple for a given
+// descriptor is built once and shared until xpcom shutdown.
+PyObject *PyXPCOM_GetMethodDescriptorTuple( const XPTMethodDescriptor *d);
+// Release the shared tuples and stop caching new ones (xpcom-shutdown).
+void PyXPCOM_ShutdownMethodDescriptorCache();
+// Release the IID objects shared by Components we create (PyISupports.cpp)
+void PyXPCOM_ShutdownComponentCache();
+// Turn the (opt-in) map from objects to their live Components on or off.
+// Returns the previous setting.
+bool PyXPCOM_SetIdentityCacheEnabled(bool bEnable);
+// Free the recycled nsIVariant objects PyObject_AsVariant uses
+// (VariantUtils.cpp)
+void PyXPCOM_ShutdownVariantFreeList();
+// Shut down all of the above caches.
+void PyXPCOM_ShutdownCaches();
 
 // DLL reference counting functions.
 // Although we maintain the count, we never actually
@@ -845,6 +1161,23 @@ public:
 	~CEnterLeaveXPCOMFramework() {PyXPCOM_ReleaseGlobalLock();}
 };
 
+// Per-object locks, for data private to a gateway (its weak reference and
+// its chain of stubs).  The locks are striped - each object maps to one
+// of a fixed set of locks by its address - so gateways for unrelated
+// objects rarely contend.  All users of a given piece of data must pass
+// the same key (normally the "base" gateway).
+void PyXPCOM_AcquireObjectLock(const void *key);
+void PyXPCOM_ReleaseObjectLock(const void *key);
+
+// NEVER new one of these objects - only use on the stack!
+class CEnterLeaveObjectLock {
+public:
+	CEnterLeaveObjectLock(const void *key) : m_key(key) {PyXPCOM_AcquireObjectLock(m_key);}
+	~CEnterLeaveObjectLock() {PyXPCOM_ReleaseObjectLock(m_key);}
+private:
+	const void *m_key;
+};
+
 // Initialize Python and do anything else necessary to get a functioning
 // Python environment going...
 PYXPCOM_EXPORT void PyXPCOM_EnsurePythonEnvironment(void);
@@ -958,9 +1291,28 @@ NS_EXPORT_STATIC_MEMBER_(PyXPCOM_TypeObject *) ClassName::type = NULL;
 PyXPCOM_INTERFACE_DECLARE(Py_nsIComponentManager, nsIComponentManager, PyMethods_IComponentManager)
 PyXPCOM_INTERFACE_DECLARE(Py_nsIInterfaceInfoManager, nsIInterfaceInfoManager, PyMethods_IInterfaceInfoManager)
 PyXPCOM_INTERFACE_DECLARE(Py_nsIEnumerator, nsIEnumerator, PyMethods_IEnumerator)
-PyXPCOM_INTERFACE_DECLARE(Py_nsISimpleEnumerator, nsISimpleEnumerator, PyMethods_ISimpleEnumerator)
 PyXPCOM_INTERFACE_DECLARE(Py_nsIInterfaceInfo, nsIInterfaceInfo, PyMethods_IInterfaceInfo)
 PyXPCOM_INTERFACE_DECLARE(Py_nsIInputStream, nsIInputStream, PyMethods_IInputStream)
 PyXPCOM_ATTR_INTERFACE_DECLARE(Py_nsIClassInfo, nsIClassInfo, PyMethods_IClassInfo)
 PyXPCOM_ATTR_INTERFACE_DECLARE(Py_nsIVariant, nsIVariant, PyMethods_IVariant)
+
+// nsISimpleEnumerator objects are also Python iterators, so they can't
+// use the macros above.  See PyISimpleEnumerator.cpp.
+extern struct PyMethodDef PyMethods_ISimpleEnumerator[];
+
+class Py_nsISimpleEnumerator : public Py_nsISupports
+{
+public:
+	static PyXPCOM_TypeObject *type;
+	static Py_nsISupports *Constructor(nsISupports *pInitObj, const nsIID &iid) {
+		return new Py_nsISimpleEnumerator(pInitObj, iid);
+	}
+	static void InitType();
+protected:
+	Py_nsISimpleEnumerator(nsISupports *p, const nsIID &iid) :
+		Py_nsISupports(p, iid, type) {
+		/* The IID _must_ be the IID of the interface we are wrapping! */
+		NS_ABORT_IF_FALSE(iid.Equals(NS_GET_IID(nsISimpleEnumerator)), "Bad IID");
+	}
+};
 #endif // __PYXPCOM_H__
@@ -103,6 +103,54 @@ PyObject *PyObject_FromXPTMethodDescriptor( const XPTMethodDescriptor *d)
 	return ret;
 }
 
+// Gateways hand the method descriptor tuple to the policy on every call.
+// The descriptors are immutable type library data which lives until
+// xpcom shuts down, so we build the tuple once per descriptor.  Only
+// touched with the GIL held.
+typedef nsDataHashtable<nsPtrHashKey<const XPTMethodDescriptor>, PyObject *> MethodDescriptorCache;
+static MethodDescriptorCache *g_methodDescriptorCache = nullptr;
+// Set once xpcom is shutting down - the descriptor addresses may be
+// reused after that, so we stop caching.
+static bool g_methodDescriptorCacheClosed = false;
+
+PyObject *PyXPCOM_GetMethodDescriptorTuple( const XPTMethodDescriptor *d)
+{
+	if (d==nullptr || g_methodDescriptorCacheClosed)
+		return PyObject_FromXPTMethodDescriptor(d);
+	if (!g_methodDescriptorCache)
+		g_methodDescriptorCache = new MethodDescriptorCache();
+	PyObject *ret = nullptr;
+	if (!g_methodDescriptorCache->Get(d, &ret)) {
+		ret = PyObject_FromXPTMethodDescriptor(d);
+		if (ret == NULL)
+			return NULL;
+		// The cache holds its own reference.
+		Py_INCREF(ret);
+		g_methodDescriptorCache->Put(d, ret);
+		return ret;
+	}
+	Py_INCREF(ret);
+	return ret;
+}
+
+static PLDHashOperator ReleaseMethodDescriptor(const XPTMethodDescriptor *key,
+                                               PyObject *value,
+                                               void *userData)
+{
+	Py_DECREF(value);
+	return PLDHashOperator::PL_DHASH_NEXT;
+}
+
+void PyXPCOM_ShutdownMethodDescriptorCache()
+{
+	g_methodDescriptorCacheClosed = true;
+	if (g_methodDescriptorCache) {
+		g_methodDescriptorCache->EnumerateRead(ReleaseMethodDescriptor, nullptr);
+		delete g_methodDescriptorCache;
+		g_methodDescriptorCache = nullptr;
+	}
+}
+
 PyObject *PyObject_FromXPTConstant( const XPTConstDescriptor *cd)
 {
 	if (cd == nullptr) {
@@ -98,6 +98,19 @@ PyXPCOM_TypeObject::Py_setattr(PyObject *op, char *name, PyObject *v)
 	return ((Py_nsISupports *)op)->setattr(name, v);
 }
 
+// Get the XPCOM identity of an object being compared with one of ours.
+// Our own objects remember theirs; anything else (eg, an
+// xpcom.client.Component) is queried for nsISupports each time, with
+// the reference held in |holder|.
+static nsISupports *GetIdentityForCompare(PyObject *ob, nsCOMPtr<nsISupports> &holder)
+{
+	if (Py_nsISupports::Check(ob))
+		return Py_nsISupports::GetIdentity(ob);
+	if (!Py_nsISupports::InterfaceFromPyObject(ob, NS_GET_IID(nsISupports), getter_AddRefs(holder), false))
+		return NULL;
+	return holder;
+}
+
 // @pymethod int|Py_nsISupports|__cmp__|Implements XPCOM rules for object identity.
 /*static*/int
 PyXPCOM_TypeObject::Py_cmp(PyObject *self, PyObject *other)
@@ -105,31 +118,46 @@ PyXPCOM_TypeObject::Py_cmp(PyObject *self, PyObject *other)
 	// @comm As per the XPCOM rules for object identity, both objects are queried for nsISupports, and these values compared.
 	// The only meaningful test is for equality - the result of other comparisons is undefined
 	// (ie, determined by the object's relative addresses in memory.
-	nsISupports *pUnkOther;
-	nsISupports *pUnkThis;
-	if (!Py_nsISupports::InterfaceFromPyObject(self, NS_GET_IID(nsISupports), &pUnkThis, false))
+	nsCOMPtr<nsISupports> holdThis, holdOther;
+	nsISupports *pUnkThis = GetIdentityForCompare(self, holdThis);
+	if (pUnkThis==NULL)
 		return -1;
-	if (!Py_nsISupports::InterfaceFromPyObject(other, NS_GET_IID(nsISupports), &pUnkOther, false)) {
-		pUnkThis->Release();
+	nsISupports *pUnkOther = GetIdentityForCompare(other, holdOther);
+	if (pUnkOther==NULL)
 		return -1;
-	}
-	int rc = pUnkThis==pUnkOther ? 0 :
+	return pUnkThis==pUnkOther ? 0 :
 		(pUnkThis < pUnkOther ? -1 : 1);
-	pUnkThis->Release();
-	pUnkOther->Release();
-	return rc;
+}
+
+// Equality tests between two XPCOM objects compare their identities
+// directly.  For anything else (ordering, or an object which isn't an
+// XPCOM object) we return NotImplemented, leaving Python to try the
+// other object and then fall back to __cmp__.
+/*static*/PyObject *
+PyXPCOM_TypeObject::Py_richcmp(PyObject *self, PyObject *other, int op)
+{
+	if ((op != Py_EQ && op != Py_NE) ||
+	    !Py_nsISupports::Check(self) || !Py_nsISupports::Check(other)) {
+		Py_INCREF(Py_NotImplemented);
+		return Py_NotImplemented;
+	}
+	nsISupports *pUnkThis = Py_nsISupports::GetIdentity(self);
+	if (pUnkThis==NULL)
+		return NULL;
+	nsISupports *pUnkOther = Py_nsISupports::GetIdentity(other);
+	if (pUnkOther==NULL)
+		return NULL;
+	return PyBool_FromLong((pUnkThis==pUnkOther) == (op == Py_EQ));
 }
 
 // @pymethod int|Py_nsISupports|__hash__|Implement a hash-code for the XPCOM object using XPCOM identity rules.
 /*static*/long PyXPCOM_TypeObject::Py_hash(PyObject *self)
 {
 	// We always return the value of the nsISupports *.
-	nsISupports *pUnkThis;
-	if (!Py_nsISupports::InterfaceFromPyObject(self, NS_GET_IID(nsISupports), &pUnkThis, false))
+	nsISupports *pUnkThis = Py_nsISupports::GetIdentity(self);
+	if (pUnkThis==NULL)
 		return -1;
-	long ret = _Py_HashPointer(pUnkThis);
-	pUnkThis->Release();
-	return ret;
+	return _Py_HashPointer(pUnkThis);
 }
 
 // @method string|Py_nsISupports|__repr__|Called to create a representation of a Py_nsISupports object
@@ -206,11 +234,11 @@ PyXPCOM_TypeObject::PyXPCOM_TypeObject( const char *name, PyXPCOM_TypeObject *pB
 		0,                                           /* tp_getattro */
 		0,                                           /*tp_setattro */
 		0,                                           /* tp_as_buffer */
-		0,                                           /* tp_flags */
+		Py_TPFLAGS_HAVE_RICHCOMPARE,                 /* tp_flags */
 		0,                                           /* tp_doc */
 		0,                                           /* tp_traverse */
 		0,                                           /* tp_clear */
-		0,                                           /* tp_richcompare */
+		Py_richcmp,                                  /* tp_richcompare */
 		0,                                           /* tp_weaklistoffset */
 		0,                                           /* tp_iter */
 		0,                                           /* tp_iternext */
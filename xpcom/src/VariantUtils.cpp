@@ -50,6 +50,7 @@
 
 #include "PyXPCOM_std.h"
 #include "mozilla/Assertions.h"
+#include "prthread.h"
 
 static mozilla::fallible_t fallible;
 
@@ -57,8 +58,105 @@ static mozilla::fallible_t fallible;
 // nsString utilities
 // ------------------------------------------------------------------------
 
-#define PyUnicode_Fromchar16_t(src, size) \
-	PyUnicode_DecodeUTF16((char*)(src),sizeof(char16_t)*(size),NULL,NULL)
+/**
+ * Create a Python unicode object from a UTF-16 buffer, decoding directly
+ * into the new object.
+ */
+static PyObject *
+PyUnicode_Fromchar16_t(const char16_t *src, PRUint32 size)
+{
+	// PyUnicode_DecodeUTF16, which we used to use, drops a leading byte
+	// order mark - as do we.  A swapped one is left to it.
+	if (size > 0 && src[0] == 0xFEFF) {
+		src++;
+		size--;
+	} else if (size > 0 && src[0] == 0xFFFE)
+		return PyUnicode_DecodeUTF16((const char *)src,
+		                             sizeof(char16_t) * size, NULL, NULL);
+	// Count the surrogate pairs (which are a single character in UCS4
+	// builds), and check there are no unpaired ones.
+	PRUint32 pairs = 0;
+	for (PRUint32 i = 0; i < size; i++) {
+		char16_t ch = src[i];
+		if (ch >= 0xD800 && ch <= 0xDFFF) {
+			if (ch <= 0xDBFF && i + 1 < size &&
+			    src[i+1] >= 0xDC00 && src[i+1] <= 0xDFFF) {
+				pairs++;
+				i++;
+			} else
+				// Let the codec report the bad data, as it always has.
+				return PyUnicode_DecodeUTF16((const char *)src,
+				                             sizeof(char16_t) * size,
+				                             NULL, NULL);
+		}
+	}
+#if Py_UNICODE_SIZE == 2
+	return PyUnicode_FromUnicode(reinterpret_cast<const Py_UNICODE *>(src), size);
+#else
+	PyObject *ret = PyUnicode_FromUnicode(NULL, size - pairs);
+	if (!ret)
+		return NULL;
+	Py_UNICODE *dest = PyUnicode_AS_UNICODE(ret);
+	if (pairs == 0) {
+		// The usual case - a simple widening loop the compiler can
+		// vectorize.
+		for (PRUint32 i = 0; i < size; i++)
+			dest[i] = src[i];
+		return ret;
+	}
+	for (PRUint32 i = 0; i < size; i++) {
+		Py_UCS4 ch = src[i];
+		if (ch >= 0xD800 && ch <= 0xDBFF) {
+			ch = 0x10000 + (((ch & 0x3FF) << 10) | (src[i+1] & 0x3FF));
+			i++;
+		}
+		*dest++ = ch;
+	}
+	return ret;
+#endif
+}
+
+// The number of UTF-16 code units needed for a Python unicode buffer.
+static PRUint32 UTF16LengthOfUnicode(const Py_UNICODE *src, Py_ssize_t len)
+{
+#if Py_UNICODE_SIZE == 2
+	return len;
+#else
+	// Characters outside the BMP take a surrogate pair.
+	PRUint32 extra = 0;
+	for (Py_ssize_t i = 0; i < len; i++)
+		extra += src[i] > 0xFFFF;
+	return len + extra;
+#endif
+}
+
+// Transcode a Python unicode buffer straight into |dest|, which must have
+// room for the |dest_len| units UTF16LengthOfUnicode() gave.
+static void CopyUnicodeToUTF16(const Py_UNICODE *src, Py_ssize_t len,
+                               char16_t *dest, PRUint32 dest_len)
+{
+#if Py_UNICODE_SIZE == 2
+	memcpy(dest, src, sizeof(char16_t) * len);
+#else
+	if (dest_len == (PRUint32)len) {
+		// All in the BMP - a simple narrowing loop the compiler can
+		// vectorize.
+		for (Py_ssize_t i = 0; i < len; i++)
+			dest[i] = static_cast<char16_t>(src[i]);
+		return;
+	}
+	for (Py_ssize_t i = 0; i < len; i++) {
+		Py_UCS4 ch = src[i];
+		if (ch > 0xFFFF) {
+			// As PyUnicode_EncodeUTF16 does.
+			ch -= 0x10000;
+			*dest++ = static_cast<char16_t>(0xD800 | (ch >> 10));
+			*dest++ = static_cast<char16_t>(0xDC00 | (ch & 0x3FF));
+		} else
+			*dest++ = static_cast<char16_t>(ch);
+	}
+#endif
+}
 
 /**
  * Copy a Python unicode string to a zero-terminated char16_t buffer
@@ -76,23 +174,27 @@ static int
 PyUnicode_Aschar16_t(PyObject *obj, char16_t **dest_out, PRUint32 *size_out)
 {
 	PRUint32 size;
-	PyObject *s;
 	char16_t *dest;
 
 	MOZ_ASSERT(PyGILState_GetThisThreadState());
 	MOZ_ASSERT(dest_out, "PyUnicode_Aschar16_t: dest_out was null");
 
-	s = PyUnicode_AsUTF16String(obj);
-	if (!s)
+	if (!PyUnicode_Check(obj)) {
+		PyErr_BadArgument();
 		return -1;
-	size = (PyString_GET_SIZE(s) - 2) / sizeof(char16_t); // remove BOM
+	}
+	// We transcode directly from the unicode object's buffer, rather
+	// than via PyUnicode_AsUTF16String (which would need a copy, and
+	// adds a byte order mark some Mozilla libraries don't like).
+	const Py_UNICODE *src = PyUnicode_AS_UNICODE(obj);
+	Py_ssize_t len = PyUnicode_GET_SIZE(obj);
+	size = UTF16LengthOfUnicode(src, len);
 	if (*dest_out) {
 		MOZ_ASSERT(size_out, "Can't have preallocated buffer of unknown size");
 		uint32_t buffer_size = *size_out;
 		*size_out = size;
 		if (buffer_size <= *size_out) {
 			PyErr_NoMemory();
-			Py_DECREF(s);
 			return -1;
 		}
 		dest = *dest_out;
@@ -100,15 +202,10 @@ PyUnicode_Aschar16_t(PyObject *obj, char16_t **dest_out, PRUint32 *size_out)
 		dest = reinterpret_cast<char16_t *>(moz_malloc(sizeof(char16_t) * (size + 1)));
 		if (!dest) {
 			PyErr_NoMemory();
-			Py_DECREF(s);
 			return -1;
 		}
 	}
-	// Drop the UTF-16 byte order mark at the beginning of
-	// the string.  (See the docs on PyUnicode_AsUTF16String.)
-	// Some Mozilla libraries don't like the mark.
-	memcpy(dest, PyString_AS_STRING(s) + 2, sizeof(char16_t) * size);
-	Py_DECREF(s);
+	CopyUnicodeToUTF16(src, len, dest, size);
 	dest[size] = 0;
 	*dest_out = dest;
 	if (size_out)
@@ -125,13 +222,12 @@ PyObject_FromNSString( const nsACString &s, bool bAssumeUTF8 /*= false */)
 		ret = Py_None;
 		Py_INCREF(Py_None);
 	} else {
-		if (bAssumeUTF8) {
-			const nsCString temp(s);
-			ret = PyUnicode_DecodeUTF8(temp.get(), temp.Length(), NULL);
-		} else {
-			NS_ConvertASCIItoUTF16 temp(s);
-			ret = PyUnicode_Fromchar16_t(temp.get(), temp.Length());
-		}
+		// Decode straight from the string's buffer.
+		if (bAssumeUTF8)
+			ret = PyUnicode_DecodeUTF8(s.BeginReading(), s.Length(), NULL);
+		else
+			// As NS_ConvertASCIItoUTF16 - each byte is a character.
+			ret = PyUnicode_DecodeLatin1(s.BeginReading(), s.Length(), NULL);
 	}
 	return ret;
 }
@@ -162,8 +258,7 @@ PyObject_FromNSString( const nsAString &s )
 		ret = Py_None;
 		Py_INCREF(Py_None);
 	} else {
-		const nsString temp(s);
-		ret = PyUnicode_Fromchar16_t(temp.get(), temp.Length());
+		ret = PyUnicode_Fromchar16_t(s.BeginReading(), s.Length());
 	}
 	return ret;
 }
@@ -196,16 +291,17 @@ PyObject_AsNSString( PyObject *val, nsAString &aStr)
 		aStr.Truncate();
 	}
 	else {
-		PyObject *s = PyUnicode_AsUTF16String(val_use);
-		if (!s) {
+		// Transcode straight into the string's own buffer.
+		const Py_UNICODE *src = PyUnicode_AS_UNICODE(val_use);
+		Py_ssize_t len = PyUnicode_GET_SIZE(val_use);
+		PRUint32 size = UTF16LengthOfUnicode(src, len);
+		aStr.SetLength(size);
+		if (aStr.Length() != size) {
 			Py_DECREF(val_use);
+			PyErr_NoMemory();
 			return false;
 		}
-		// Skip the BOM at the start of the string
-		// (see PyUnicode_Aschar16_t)
-		aStr.Assign(reinterpret_cast<char16_t*>(PyString_AS_STRING(s)) + 1,
-			    (PyString_GET_SIZE(s) / sizeof(char16_t)) - 1);
-		Py_DECREF(s);
+		CopyUnicodeToUTF16(src, len, aStr.BeginWriting(), size);
 	}
 	Py_DECREF(val_use);
 	return true;
@@ -320,6 +416,200 @@ void FreeSingleArray(void *array_ptr, PRUint32 sequence_size, PRUint8 array_type
 	}
 }
 
+// Numeric arrays can be filled from any object exposing a contiguous
+// buffer of numbers (array.array, bytearray, numpy arrays etc) without
+// creating a Python object per element.
+
+// The array type matching a buffer's element format, or -1 if it has none.
+static int ArrayTypeForBufferFormat(const char *format, Py_ssize_t itemsize)
+{
+	if (format==NULL)
+		format = "B";
+	// Only native byte order will do.
+	if (*format == '@' || *format == '=')
+		format++;
+	if (format[0]=='\0' || format[1]!='\0')
+		return -1;
+	switch (*format) {
+		case 'b': case 'h': case 'i': case 'l': case 'q':
+			switch (itemsize) {
+				case 1: return TD_INT8;
+				case 2: return TD_INT16;
+				case 4: return TD_INT32;
+				case 8: return TD_INT64;
+			}
+			break;
+		case 'B': case 'H': case 'I': case 'L': case 'Q':
+			switch (itemsize) {
+				case 1: return TD_UINT8;
+				case 2: return TD_UINT16;
+				case 4: return TD_UINT32;
+				case 8: return TD_UINT64;
+			}
+			break;
+		case 'f':
+			if (itemsize == sizeof(float)) return TD_FLOAT;
+			break;
+		case 'd':
+			if (itemsize == sizeof(double)) return TD_DOUBLE;
+			break;
+		case '?':
+			if (itemsize == sizeof(bool)) return TD_BOOL;
+			break;
+	}
+	return -1;
+}
+
+template<typename To, typename From>
+static void ConvertArrayElements(To *dest, const From *src, PRUint32 count)
+{
+	// A plain loop the compiler is free to vectorize.
+	for (PRUint32 i = 0; i < count; i++)
+		dest[i] = static_cast<To>(src[i]);
+}
+
+template<typename From>
+static void ConvertArrayElements(bool *dest, const From *src, PRUint32 count)
+{
+	for (PRUint32 i = 0; i < count; i++)
+		dest[i] = src[i] != 0;
+}
+
+template<typename To>
+static void ConvertBufferElements(To *dest, const void *src, int src_type, PRUint32 count)
+{
+	switch (src_type) {
+		case TD_INT8: ConvertArrayElements(dest, (const PRInt8 *)src, count); break;
+		case TD_INT16: ConvertArrayElements(dest, (const PRInt16 *)src, count); break;
+		case TD_INT32: ConvertArrayElements(dest, (const PRInt32 *)src, count); break;
+		case TD_INT64: ConvertArrayElements(dest, (const PRInt64 *)src, count); break;
+		case TD_UINT8: ConvertArrayElements(dest, (const PRUint8 *)src, count); break;
+		case TD_UINT16: ConvertArrayElements(dest, (const PRUint16 *)src, count); break;
+		case TD_UINT32: ConvertArrayElements(dest, (const PRUint32 *)src, count); break;
+		case TD_UINT64: ConvertArrayElements(dest, (const PRUint64 *)src, count); break;
+		case TD_FLOAT: ConvertArrayElements(dest, (const float *)src, count); break;
+		case TD_DOUBLE: ConvertArrayElements(dest, (const double *)src, count); break;
+		case TD_BOOL: ConvertArrayElements(dest, (const bool *)src, count); break;
+		default: MOZ_CRASH("Unexpected buffer type");
+	}
+}
+
+// Converting a floating point value to an integer type it doesn't fit
+// (including NaN and infinities) is undefined, so such buffers are only
+// converted directly if every element is in range.  Others are left to
+// the sequence path, which converts (or rejects) each element as before.
+template<typename From>
+static bool FloatElementsInRange(const From *src, PRUint32 count,
+                                 double lower, double upper)
+{
+	for (PRUint32 i = 0; i < count; i++) {
+		if (!(src[i] >= lower && src[i] < upper))
+			return false;
+	}
+	return true;
+}
+
+static bool BufferElementsConvertible(const void *src, int src_type,
+                                      int array_type, PRUint32 count)
+{
+	if (src_type != TD_FLOAT && src_type != TD_DOUBLE)
+		return true;
+	double lower, upper;
+	switch (array_type) {
+		case TD_INT8: lower = -128.0; upper = 128.0; break;
+		case TD_INT16: lower = -32768.0; upper = 32768.0; break;
+		case TD_INT32: lower = -2147483648.0; upper = 2147483648.0; break;
+		case TD_INT64: lower = -9223372036854775808.0; upper = 9223372036854775808.0; break;
+		case TD_UINT8: lower = 0.0; upper = 256.0; break;
+		case TD_UINT16: lower = 0.0; upper = 65536.0; break;
+		case TD_UINT32: lower = 0.0; upper = 4294967296.0; break;
+		case TD_UINT64: lower = 0.0; upper = 18446744073709551616.0; break;
+		default: return true; // float, double and bool are always fine.
+	}
+	if (src_type == TD_FLOAT)
+		return FloatElementsInRange((const float *)src, count, lower, upper);
+	return FloatElementsInRange((const double *)src, count, lower, upper);
+}
+
+// Fill a numeric array from the object's buffer, either with a straight
+// copy or (if the element types differ) converting each element.
+// Returns false, with no exception set, if the object has no suitable
+// buffer so the caller must treat it as a sequence.
+static bool FillNumericArrayFromBuffer(void *array_ptr, PyObject *ob,
+                                       PRUint32 sequence_size,
+                                       PRUint32 array_element_size,
+                                       XPTTypeDescriptorTags array_type)
+{
+	switch (array_type) {
+		case TD_INT8: case TD_INT16: case TD_INT32: case TD_INT64:
+		case TD_UINT8: case TD_UINT16: case TD_UINT32: case TD_UINT64:
+		case TD_FLOAT: case TD_DOUBLE: case TD_BOOL:
+			break;
+		default:
+			return false;
+	}
+	// Strings are sequences of characters, not of bytes (which is how
+	// their buffers would be seen) - and T_U8 has already handled them.
+	if (PyString_Check(ob) || PyUnicode_Check(ob))
+		return false;
+
+	Py_buffer view;
+	const void *buf = NULL;
+	Py_ssize_t buf_len = 0;
+	int src_type = -1;
+	bool bHaveView = false;
+	if (PyObject_CheckBuffer(ob)) {
+		if (PyObject_GetBuffer(ob, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+			PyErr_Clear();
+			return false;
+		}
+		bHaveView = true;
+		if (view.ndim <= 1) {
+			buf = view.buf;
+			buf_len = view.len;
+			src_type = ArrayTypeForBufferFormat(view.format, view.itemsize);
+		}
+	} else if (strcmp(Py_TYPE(ob)->tp_name, "array.array") == 0) {
+		// array.array only has the old buffer interface - its
+		// typecode tells us what it holds.
+		PyObject *typecode = PyObject_GetAttrString(ob, "typecode");
+		PyObject *itemsize = PyObject_GetAttrString(ob, "itemsize");
+		if (typecode && itemsize && PyString_Check(typecode) && PyInt_Check(itemsize) &&
+		    PyObject_AsReadBuffer(ob, &buf, &buf_len) == 0)
+			src_type = ArrayTypeForBufferFormat(PyString_AS_STRING(typecode),
+			                                    PyInt_AS_LONG(itemsize));
+		Py_XDECREF(typecode);
+		Py_XDECREF(itemsize);
+		PyErr_Clear();
+	}
+	bool handled = src_type != -1 &&
+		buf_len == (Py_ssize_t)sequence_size * (Py_ssize_t)GetArrayElementSize((XPTTypeDescriptorTags)src_type) &&
+		BufferElementsConvertible(buf, src_type, array_type, sequence_size);
+	if (handled) {
+		if (src_type == array_type)
+			memcpy(array_ptr, buf, sequence_size * array_element_size);
+		else {
+			switch (array_type) {
+				case TD_INT8: ConvertBufferElements((PRInt8 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_INT16: ConvertBufferElements((PRInt16 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_INT32: ConvertBufferElements((PRInt32 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_INT64: ConvertBufferElements((PRInt64 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_UINT8: ConvertBufferElements((PRUint8 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_UINT16: ConvertBufferElements((PRUint16 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_UINT32: ConvertBufferElements((PRUint32 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_UINT64: ConvertBufferElements((PRUint64 *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_FLOAT: ConvertBufferElements((float *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_DOUBLE: ConvertBufferElements((double *)array_ptr, buf, src_type, sequence_size); break;
+				case TD_BOOL: ConvertBufferElements((bool *)array_ptr, buf, src_type, sequence_size); break;
+				default: MOZ_CRASH("Unexpected array type");
+			}
+		}
+	}
+	if (bHaveView)
+		PyBuffer_Release(&view);
+	return handled;
+}
+
 #define FILL_SIMPLE_POINTER( type, val ) *reinterpret_cast<type*>(pthis) = (type)(val)
 #define BREAK_FALSE {rc=false;break;}
 
@@ -354,6 +644,10 @@ bool FillSingleArray(void *array_ptr, PyObject *sequence_ob, PRUint32 sequence_s
 			Py_DECREF(sequence_ob);
 		return true;
 	}
+	// Numbers in a buffer can be copied (or converted) in one go.
+	if (FillNumericArrayFromBuffer(pthis, sequence_ob, sequence_size,
+	                               array_element_size, array_type))
+		return true;
 
 	for (PRUint32 i = 0; rc && i < sequence_size; i++, pthis += array_element_size) {
 		PyObject *val = PySequence_GetItem(sequence_ob, i);
@@ -708,62 +1002,198 @@ static PRUint16 BestVariantTypeForPyObject( PyObject *ob, BVFTResult *pdata)
 	return (PRUint16)-1;
 }
 
+// PyXPCOM_Variant - the nsIVariant we build from Python objects.
+//
+// Rather than creating a "@mozilla.org/variant;1" for every conversion,
+// we use this.  It holds the value as it came from Python (strings are
+// kept as the Python objects themselves, so are never copied unless asked
+// for) and answers the common requests - the value in its own type -
+// directly.  Anything else (type conversions, or modifying it via
+// nsIWritableVariant) is handed to a real Mozilla variant, created with a
+// copy of the value only when first needed.
+
+// The base just forwards everything to the real variant.
+class PyXPCOM_VariantForwarder : public nsIWritableVariant {
+public:
+	NS_FORWARD_SAFE_NSIVARIANT(Delegate())
+	NS_FORWARD_SAFE_NSIWRITABLEVARIANT(Delegate())
+protected:
+	virtual ~PyXPCOM_VariantForwarder() {}
+	// The real variant, or NULL if it couldn't be created.
+	virtual nsIWritableVariant *Delegate() = 0;
+};
+
+class PyXPCOM_Variant : public PyXPCOM_VariantForwarder {
+public:
+	PyXPCOM_Variant();
+	NS_DECL_THREADSAFE_ISUPPORTS
+	// The value's own type (plus a few lossless conversions) we do
+	// ourselves.
+	NS_IMETHOD GetDataType(uint16_t *aDataType);
+	NS_IMETHOD GetAsBool(bool *_retval);
+	NS_IMETHOD GetAsInt32(int32_t *_retval);
+	NS_IMETHOD GetAsInt64(int64_t *_retval);
+	NS_IMETHOD GetAsDouble(double *_retval);
+	NS_IMETHOD GetAsID(nsID *_retval);
+	NS_IMETHOD GetAsACString(nsACString & _retval);
+	NS_IMETHOD GetAsString(char * *_retval);
+	NS_IMETHOD GetAsStringWithSize(uint32_t *size, char * *str);
+	NS_IMETHOD GetAsAString(nsAString & _retval);
+	NS_IMETHOD GetAsWString(char16_t * *_retval);
+	NS_IMETHOD GetAsWStringWithSize(uint32_t *size, char16_t * *str);
+	NS_IMETHOD GetAsISupports(nsISupports * *_retval);
+	NS_IMETHOD GetAsInterface(nsIID **iid, void **iface);
+	NS_IMETHOD GetAsArray(uint16_t *type, nsIID *iid, uint32_t *count, void **ptr);
+
+	// Set the value from a Python object; must hold the GIL.
+	nsresult Init(PyObject *ob, PRUint16 dt, BVFTResult &cvt_result);
+
+	// Instances are recycled via a free list.
+	static void *operator new(size_t size);
+	static void operator delete(void *p);
+	static void ShutdownFreeList();
+protected:
+	virtual nsIWritableVariant *Delegate();
+private:
+	~PyXPCOM_Variant();
+	nsresult CopyValueTo(nsIWritableVariant *v);
+	bool HaveOwnValue(PRUint16 type) const {
+		return mType == type && !mDelegate;
+	}
+
+	PRUint16 mType;
+	union {
+		bool b;
+		PRInt32 i32;
+		PRInt64 i64;
+		double d;
+	} mValue;
+	nsIID mIID; // VTYPE_ID, and the IID of a VTYPE_INTERFACE_IS
+	nsISupports *mInterface;
+	PyObject *mPyString; // A str or unicode object.
+	nsIVariant **mArray;
+	PRUint32 mArrayCount;
+	mozilla::Atomic<nsIWritableVariant *, mozilla::ReleaseAcquire> mDelegate;
+};
+
+NS_IMPL_ISUPPORTS(PyXPCOM_Variant, nsIVariant, nsIWritableVariant)
+
+// The free list.  Variants are only created with the GIL held, so only
+// one thread at a time takes from the list - but they may be put back
+// by any thread.
+struct PyXPCOM_FreeVariant {
+	PyXPCOM_FreeVariant *next;
+};
+static mozilla::Atomic<PyXPCOM_FreeVariant *, mozilla::ReleaseAcquire> gFreeVariants;
+static mozilla::Atomic<PRUint32> gNumFreeVariants;
+#define MAX_FREE_VARIANTS 128
+
+/*static*/ void *
+PyXPCOM_Variant::operator new(size_t size)
+{
+	MOZ_ASSERT(PyGILState_GetThisThreadState());
+	MOZ_ASSERT(size == sizeof(PyXPCOM_Variant));
+	PyXPCOM_FreeVariant *head;
+	do {
+		head = gFreeVariants;
+		if (!head)
+			return moz_xmalloc(size);
+	} while (!gFreeVariants.compareExchange(head, head->next));
+	--gNumFreeVariants;
+	return head;
+}
+
+/*static*/ void
+PyXPCOM_Variant::operator delete(void *p)
+{
+	if (gNumFreeVariants >= MAX_FREE_VARIANTS) {
+		moz_free(p);
+		return;
+	}
+	PyXPCOM_FreeVariant *item = reinterpret_cast<PyXPCOM_FreeVariant *>(p);
+	PyXPCOM_FreeVariant *head;
+	do {
+		head = gFreeVariants;
+		item->next = head;
+	} while (!gFreeVariants.compareExchange(head, item));
+	++gNumFreeVariants;
+}
+
+/*static*/ void
+PyXPCOM_Variant::ShutdownFreeList()
+{
+	PyXPCOM_FreeVariant *item = gFreeVariants.exchange(nullptr);
+	while (item) {
+		PyXPCOM_FreeVariant *next = item->next;
+		moz_free(item);
+		--gNumFreeVariants;
+		item = next;
+	}
+}
+
+void PyXPCOM_ShutdownVariantFreeList()
+{
+	PyXPCOM_Variant::ShutdownFreeList();
+}
+
+PyXPCOM_Variant::PyXPCOM_Variant()
+	: mType(nsIDataType::VTYPE_EMPTY),
+	  mIID(Py_nsIID_NULL),
+	  mInterface(nullptr),
+	  mPyString(nullptr),
+	  mArray(nullptr),
+	  mArrayCount(0),
+	  mDelegate(nullptr)
+{
+	mValue.i64 = 0;
+}
+
+PyXPCOM_Variant::~PyXPCOM_Variant()
+{
+	nsIWritableVariant *d = mDelegate;
+	NS_IF_RELEASE(d);
+	NS_IF_RELEASE(mInterface);
+	if (mArray)
+		NS_FREE_XPCOM_ISUPPORTS_POINTER_ARRAY(mArrayCount, mArray);
+	if (mPyString) {
+		CEnterLeavePython _celp;
+		Py_DECREF(mPyString);
+	}
+}
+
 nsresult
-PyObject_AsVariant( PyObject *ob, nsIVariant **aRet)
+PyXPCOM_Variant::Init(PyObject *ob, PRUint16 dt, BVFTResult &cvt_result)
 {
 	MOZ_ASSERT(PyGILState_GetThisThreadState());
 	nsresult nr = NS_OK;
-	nsCOMPtr<nsIWritableVariant> v = do_CreateInstance("@mozilla.org/variant;1", &nr);
-	NS_ENSURE_SUCCESS(nr, nr);
-	// *sigh* - I tried the abstract API (PyNumber_Check, etc)
-	// but our COM instances too often qualify.
-	BVFTResult cvt_result;
-	PRUint16 dt = BestVariantTypeForPyObject(ob, &cvt_result);
+	mType = dt;
 	switch (dt) {
 		case nsIDataType::VTYPE_BOOL:
-			nr = v->SetAsBool(ob==Py_True);
+			mValue.b = ob==Py_True;
 			break;
 		case nsIDataType::VTYPE_INT32:
-			nr = v->SetAsInt32(PyInt_AsLong(ob));
+			mValue.i32 = PyInt_AsLong(ob);
 			break;
 		case nsIDataType::VTYPE_INT64:
-			nr = v->SetAsInt64(PyLong_AsLongLong(ob));
+			mValue.i64 = PyLong_AsLongLong(ob);
 			break;
 		case nsIDataType::VTYPE_DOUBLE:
-			nr = v->SetAsDouble(PyFloat_AsDouble(ob));
+			mValue.d = PyFloat_AsDouble(ob);
 			break;
 		case nsIDataType::VTYPE_STRING_SIZE_IS:
-			nr = v->SetAsStringWithSize(PyString_Size(ob), PyString_AsString(ob));
-			break;
 		case nsIDataType::VTYPE_WSTRING_SIZE_IS:
-			if (PyUnicode_GetSize(ob) == 0) {
-				nr = v->SetAsWStringWithSize(0, (char16_t*)NULL);
-			}
-			else {
-				PRUint32 nch;
-				char16_t *p = nullptr;
-				if (PyUnicode_Aschar16_t(ob, &p, &nch) < 0) {
-					PyXPCOM_LogWarning("Failed to convert object to unicode", ob->ob_type->tp_name);
-					nr = NS_ERROR_UNEXPECTED;
-					break;
-				}
-				nr = v->SetAsWStringWithSize(nch, p);
-				nsMemory::Free(p);
-			}
+			// Python strings are immutable, so we can just keep it.
+			mPyString = ob;
+			Py_INCREF(ob);
 			break;
 		case nsIDataType::VTYPE_INTERFACE_IS:
-		{
-			nsISupports *ps = cvt_result.pis;
-			nr = v->SetAsInterface(cvt_result.iid, ps);
-			if (ps) {
-				Py_BEGIN_ALLOW_THREADS; // MUST release thread-lock, incase a Python COM object that re-acquires.
-				ps->Release();
-				Py_END_ALLOW_THREADS;
-			}
+			// Take over the reference BestVariantTypeForPyObject got.
+			mInterface = cvt_result.pis;
+			cvt_result.pis = nullptr;
+			mIID = cvt_result.iid;
 			break;
-		}
 		case nsIDataType::VTYPE_ID:
-			nr = v->SetAsID(cvt_result.iid);
+			mIID = cvt_result.iid;
 			break;
 		case nsIDataType::VTYPE_ARRAY:
 		{
@@ -772,9 +1202,12 @@ PyObject_AsVariant( PyObject *ob, nsIVariant **aRet)
 			int seq_length = PySequence_Length(ob);
 			int i;
 
-			nsIVariant** buf = ::new (fallible) nsIVariant*[seq_length];
+			nsIVariant** buf = reinterpret_cast<nsIVariant **>(
+				moz_malloc(sizeof(nsIVariant *) * seq_length));
 			NS_ENSURE_TRUE(buf, NS_ERROR_OUT_OF_MEMORY);
 			memset(buf, 0, sizeof(nsIVariant *) * seq_length);
+			mArray = buf;
+			mArrayCount = seq_length;
 			for (i = 0; NS_SUCCEEDED(nr) && i < seq_length; i++) {
 				PyObject *sub = PySequence_GetItem(ob, i);
 				if (!sub) {
@@ -784,32 +1217,287 @@ PyObject_AsVariant( PyObject *ob, nsIVariant **aRet)
 				nr = PyObject_AsVariant(sub, &buf[i]);
 				Py_DECREF(sub);
 			}
-			if (NS_SUCCEEDED(nr)) {
-				nr = v->SetAsArray(nsXPTType::T_INTERFACE_IS,
-				                   &NS_GET_IID(nsIVariant),
-				                   seq_length, buf);
-			}
-			// Clean things up.
-			NS_FREE_XPCOM_ISUPPORTS_POINTER_ARRAY(seq_length, buf);
 			break;
 		}
 		case nsIDataType::VTYPE_EMPTY:
-			nr = v->SetAsEmpty();
-			break;
 		case nsIDataType::VTYPE_EMPTY_ARRAY:
-			nr = v->SetAsEmptyArray();
 			break;
-		case (PRUint16)-1:
-			PyXPCOM_LogWarning("Objects of type '%s' can not be converted to an nsIVariant", ob->ob_type->tp_name);
-			nr = NS_ERROR_UNEXPECTED;
 		default:
 			MOZ_CRASH("BestVariantTypeForPyObject() returned a variant type not handled here!");
-			PyXPCOM_LogWarning("Objects of type '%s' can not be converted to an nsIVariant", ob->ob_type->tp_name);
 			nr = NS_ERROR_UNEXPECTED;
 	}
-	if (NS_FAILED(nr))
+	return nr;
+}
+
+// Set a real variant to our value.  Doesn't need the GIL - all we use
+// of our string objects is their (immutable) data.
+nsresult
+PyXPCOM_Variant::CopyValueTo(nsIWritableVariant *v)
+{
+	switch (mType) {
+		case nsIDataType::VTYPE_BOOL:
+			return v->SetAsBool(mValue.b);
+		case nsIDataType::VTYPE_INT32:
+			return v->SetAsInt32(mValue.i32);
+		case nsIDataType::VTYPE_INT64:
+			return v->SetAsInt64(mValue.i64);
+		case nsIDataType::VTYPE_DOUBLE:
+			return v->SetAsDouble(mValue.d);
+		case nsIDataType::VTYPE_STRING_SIZE_IS:
+			return v->SetAsStringWithSize(PyString_GET_SIZE(mPyString),
+			                              PyString_AS_STRING(mPyString));
+		case nsIDataType::VTYPE_WSTRING_SIZE_IS: {
+			PRUint32 nch;
+			char16_t *p;
+			nsresult nr = GetAsWStringWithSize(&nch, &p);
+			if (NS_FAILED(nr))
+				return nr;
+			nr = v->SetAsWStringWithSize(nch, p);
+			nsMemory::Free(p);
+			return nr;
+		}
+		case nsIDataType::VTYPE_INTERFACE_IS:
+			return v->SetAsInterface(mIID, mInterface);
+		case nsIDataType::VTYPE_ID:
+			return v->SetAsID(mIID);
+		case nsIDataType::VTYPE_ARRAY:
+			return v->SetAsArray(nsXPTType::T_INTERFACE_IS,
+			                     &NS_GET_IID(nsIVariant),
+			                     mArrayCount, mArray);
+		case nsIDataType::VTYPE_EMPTY_ARRAY:
+			return v->SetAsEmptyArray();
+		case nsIDataType::VTYPE_EMPTY:
+		default:
+			return v->SetAsEmpty();
+	}
+}
+
+nsIWritableVariant *
+PyXPCOM_Variant::Delegate()
+{
+	nsIWritableVariant *d = mDelegate;
+	if (d)
+		return d;
+	nsresult nr;
+	nsCOMPtr<nsIWritableVariant> v = do_CreateInstance("@mozilla.org/variant;1", &nr);
+	if (NS_FAILED(nr) || NS_FAILED(CopyValueTo(v)))
+		return nullptr;
+	v.forget(&d);
+	if (mDelegate.compareExchange(nullptr, d))
+		return d;
+	// Another thread beat us to it.
+	NS_RELEASE(d);
+	return mDelegate;
+}
+
+#define FORWARD_TO_DELEGATE(call) { \
+	nsIWritableVariant *d = Delegate(); \
+	return d ? d->call : NS_ERROR_OUT_OF_MEMORY; \
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetDataType(uint16_t *aDataType)
+{
+	nsIWritableVariant *d = mDelegate;
+	if (d)
+		return d->GetDataType(aDataType);
+	*aDataType = mType;
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsBool(bool *_retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_BOOL))
+		FORWARD_TO_DELEGATE(GetAsBool(_retval));
+	*_retval = mValue.b;
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsInt32(int32_t *_retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_INT32))
+		FORWARD_TO_DELEGATE(GetAsInt32(_retval));
+	*_retval = mValue.i32;
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsInt64(int64_t *_retval)
+{
+	if (HaveOwnValue(nsIDataType::VTYPE_INT32))
+		*_retval = mValue.i32;
+	else if (HaveOwnValue(nsIDataType::VTYPE_INT64))
+		*_retval = mValue.i64;
+	else
+		FORWARD_TO_DELEGATE(GetAsInt64(_retval));
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsDouble(double *_retval)
+{
+	if (HaveOwnValue(nsIDataType::VTYPE_DOUBLE))
+		*_retval = mValue.d;
+	else if (HaveOwnValue(nsIDataType::VTYPE_INT32))
+		*_retval = mValue.i32;
+	else
+		FORWARD_TO_DELEGATE(GetAsDouble(_retval));
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsID(nsID *_retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_ID))
+		FORWARD_TO_DELEGATE(GetAsID(_retval));
+	*_retval = mIID;
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsACString(nsACString & _retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_STRING_SIZE_IS))
+		FORWARD_TO_DELEGATE(GetAsACString(_retval));
+	_retval.Assign(PyString_AS_STRING(mPyString), PyString_GET_SIZE(mPyString));
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsStringWithSize(uint32_t *size, char * *str)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_STRING_SIZE_IS))
+		FORWARD_TO_DELEGATE(GetAsStringWithSize(size, str));
+	PRUint32 len = PyString_GET_SIZE(mPyString);
+	char *ret = reinterpret_cast<char *>(moz_malloc(len + 1));
+	NS_ENSURE_TRUE(ret, NS_ERROR_OUT_OF_MEMORY);
+	// Python strings are always null terminated.
+	memcpy(ret, PyString_AS_STRING(mPyString), len + 1);
+	*size = len;
+	*str = ret;
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsString(char * *_retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_STRING_SIZE_IS))
+		FORWARD_TO_DELEGATE(GetAsString(_retval));
+	uint32_t size;
+	return GetAsStringWithSize(&size, _retval);
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsWStringWithSize(uint32_t *size, char16_t * *str)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_WSTRING_SIZE_IS))
+		FORWARD_TO_DELEGATE(GetAsWStringWithSize(size, str));
+	const Py_UNICODE *src = PyUnicode_AS_UNICODE(mPyString);
+	Py_ssize_t len = PyUnicode_GET_SIZE(mPyString);
+	PRUint32 nch = UTF16LengthOfUnicode(src, len);
+	char16_t *ret = reinterpret_cast<char16_t *>(moz_malloc(sizeof(char16_t) * (nch + 1)));
+	NS_ENSURE_TRUE(ret, NS_ERROR_OUT_OF_MEMORY);
+	CopyUnicodeToUTF16(src, len, ret, nch);
+	ret[nch] = 0;
+	*size = nch;
+	*str = ret;
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsWString(char16_t * *_retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_WSTRING_SIZE_IS))
+		FORWARD_TO_DELEGATE(GetAsWString(_retval));
+	uint32_t size;
+	return GetAsWStringWithSize(&size, _retval);
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsAString(nsAString & _retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_WSTRING_SIZE_IS))
+		FORWARD_TO_DELEGATE(GetAsAString(_retval));
+	const Py_UNICODE *src = PyUnicode_AS_UNICODE(mPyString);
+	Py_ssize_t len = PyUnicode_GET_SIZE(mPyString);
+	PRUint32 nch = UTF16LengthOfUnicode(src, len);
+	_retval.SetLength(nch);
+	NS_ENSURE_TRUE(_retval.Length() == nch, NS_ERROR_OUT_OF_MEMORY);
+	CopyUnicodeToUTF16(src, len, _retval.BeginWriting(), nch);
+	return NS_OK;
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsISupports(nsISupports * *_retval)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_INTERFACE_IS))
+		FORWARD_TO_DELEGATE(GetAsISupports(_retval));
+	if (!mInterface) {
+		*_retval = nullptr;
+		return NS_OK;
+	}
+	return mInterface->QueryInterface(NS_GET_IID(nsISupports), (void **)_retval);
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsInterface(nsIID **iid, void **iface)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_INTERFACE_IS))
+		FORWARD_TO_DELEGATE(GetAsInterface(iid, iface));
+	nsIID *ret_iid = reinterpret_cast<nsIID *>(moz_malloc(sizeof(nsIID)));
+	NS_ENSURE_TRUE(ret_iid, NS_ERROR_OUT_OF_MEMORY);
+	*ret_iid = mIID;
+	*iid = ret_iid;
+	if (!mInterface) {
+		*iface = nullptr;
+		return NS_OK;
+	}
+	return mInterface->QueryInterface(mIID, iface);
+}
+
+NS_IMETHODIMP
+PyXPCOM_Variant::GetAsArray(uint16_t *type, nsIID *iid, uint32_t *count, void **ptr)
+{
+	if (!HaveOwnValue(nsIDataType::VTYPE_ARRAY))
+		FORWARD_TO_DELEGATE(GetAsArray(type, iid, count, ptr));
+	nsIVariant **ret = reinterpret_cast<nsIVariant **>(
+		moz_malloc(sizeof(nsIVariant *) * mArrayCount));
+	NS_ENSURE_TRUE(ret, NS_ERROR_OUT_OF_MEMORY);
+	for (PRUint32 i = 0; i < mArrayCount; i++)
+		NS_IF_ADDREF(ret[i] = mArray[i]);
+	*type = nsXPTType::T_INTERFACE_IS;
+	*iid = NS_GET_IID(nsIVariant);
+	*count = mArrayCount;
+	*ptr = ret;
+	return NS_OK;
+}
+
+nsresult
+PyObject_AsVariant( PyObject *ob, nsIVariant **aRet)
+{
+	MOZ_ASSERT(PyGILState_GetThisThreadState());
+	// *sigh* - I tried the abstract API (PyNumber_Check, etc)
+	// but our COM instances too often qualify.
+	BVFTResult cvt_result;
+	PRUint16 dt = BestVariantTypeForPyObject(ob, &cvt_result);
+	if (dt == (PRUint16)-1) {
+		PyXPCOM_LogWarning("Objects of type '%s' can not be converted to an nsIVariant", ob->ob_type->tp_name);
+		return NS_ERROR_UNEXPECTED;
+	}
+	PyXPCOM_Variant *v = new PyXPCOM_Variant();
+	NS_ADDREF(v);
+	nsresult nr = v->Init(ob, dt, cvt_result);
+	if (NS_FAILED(nr)) {
+		// Releasing any interfaces we got may call back into Python.
+		Py_BEGIN_ALLOW_THREADS;
+		NS_RELEASE(v);
+		Py_END_ALLOW_THREADS;
 		return nr;
-	return CallQueryInterface(v, aRet);
+	}
+	*aRet = v;
+	return NS_OK;
 }
 
 #define GET_FROM_V(Type, FuncGet, FuncConvert) { \
@@ -838,6 +1526,8 @@ PyObject *PyObject_FromVariantArray( Py_nsISupports *parent, nsIVariant *v)
 	nr = v->GetAsArray(&dataType, &iid, &count, &p);
 	XPTTypeDescriptorTags type = static_cast<XPTTypeDescriptorTags>(dataType);
 	if (NS_FAILED(nr)) return PyXPCOM_BuildPyException(nr);
+	if (PyXPCOM_ArrayResult::CanAdopt(type) && p)
+		return new PyXPCOM_ArrayResult(p, count, GetArrayElementSize(type), type);
 	PyObject *ret = UnpackSingleArray(parent, p, count, type, &iid);
 	FreeSingleArray(p, count, (PRUint8)type);
 	nsMemory::Free(p);
@@ -872,9 +1562,11 @@ PyObject_FromVariant( Py_nsISupports *parent, nsIVariant *v)
 		case nsIDataType::VTYPE_INT8:
 		case nsIDataType::VTYPE_INT16:
 		case nsIDataType::VTYPE_INT32:
-			GET_FROM_V(PRInt32, v->GetAsInt32, PyInt_FromLong);
+		// These always fit in an int, and DefaultPolicy has always given
+		// them to gateways as ints.
 		case nsIDataType::VTYPE_UINT8:
 		case nsIDataType::VTYPE_UINT16:
+			GET_FROM_V(PRInt32, v->GetAsInt32, PyInt_FromLong);
 		case nsIDataType::VTYPE_UINT32:
 			GET_FROM_V(PRUint32, v->GetAsUint32, PyLong_FromUnsignedLong);
 		case nsIDataType::VTYPE_INT64:
@@ -889,7 +1581,7 @@ PyObject_FromVariant( Py_nsISupports *parent, nsIVariant *v)
 			if (NS_FAILED(nr = v->GetAsBool(&b))) {
 				goto done;
 			}
-			ret = v ? Py_True : Py_False;
+			ret = b ? Py_True : Py_False;
 			Py_INCREF(ret);
 			break;
 		}
@@ -932,7 +1624,10 @@ PyObject_FromVariant( Py_nsISupports *parent, nsIVariant *v)
 			if (NS_FAILED(nr=v->GetAsInterface(&iid, getter_AddRefs(p)))) goto done;
 			// If the variant itself holds a variant, we should
 			// probably unpack that too?
-			ret = parent->MakeInterfaceResult(p, *iid);
+			if (parent)
+				ret = parent->MakeInterfaceResult(p, *iid);
+			else
+				ret = Py_nsISupports::PyObjectFromInterface(p, *iid, true);
 			nsMemory::Free((char*)iid);
 			break;
 		// case nsIDataType::VTYPE_WCHAR_STR
@@ -1024,6 +1719,37 @@ static bool ProcessPythonTypeDescriptors(PythonTypeDescriptor *pdescs, int num,
 	return true;
 }
 
+// The thread-private index for PyXPCOM_CallArena; only touched with the
+// GIL held.
+static PRUintn gCallArenaIndex;
+static bool gCallArenaIndexValid = false;
+
+static void PR_CALLBACK DestroyCallArena(void *priv)
+{
+	delete reinterpret_cast<PyXPCOM_CallArena *>(priv);
+}
+
+/*static*/ PyXPCOM_CallArena *
+PyXPCOM_CallArena::GetForThread()
+{
+	MOZ_ASSERT(PyGILState_GetThisThreadState());
+	if (!gCallArenaIndexValid) {
+		if (PR_NewThreadPrivateIndex(&gCallArenaIndex, DestroyCallArena) != PR_SUCCESS)
+			return nullptr;
+		gCallArenaIndexValid = true;
+	}
+	PyXPCOM_CallArena *arena =
+		reinterpret_cast<PyXPCOM_CallArena *>(PR_GetThreadPrivate(gCallArenaIndex));
+	if (!arena) {
+		arena = new PyXPCOM_CallArena();
+		if (PR_SetThreadPrivate(gCallArenaIndex, arena) != PR_SUCCESS) {
+			delete arena;
+			return nullptr;
+		}
+	}
+	return arena;
+}
+
 #ifdef DEBUG
 // Allocator wrappers (to debug leaks)
 template<typename T>
@@ -1057,12 +1783,14 @@ template<typename T>
 void PyXPCOM_AllocHelper::Free(T* buf) {
 	//fprintf(stderr, "FREE: %12p [%12p/%12p] @%u\n", buf, this, &mAllocations, __LINE__);
 	mAllocations.Remove(reinterpret_cast<void*>(buf));
-	delete[] buf;
+	if (!IsArenaMemory(buf))
+		delete[] buf;
 }
 void PyXPCOM_AllocHelper::Free(void* buf) {
 	//fprintf(stderr, "FREE: %12p [%12p/%12p] @%u\n", buf, this, &mAllocations, __LINE__);
 	mAllocations.Remove(buf);
-	moz_free(buf);
+	if (!IsArenaMemory(buf))
+		moz_free(buf);
 }
 void PyXPCOM_AllocHelper::MarkFree(void* buf) {
 	//fprintf(stderr, "FREE: %12p [%12p/%12p] @%u\n", buf, this, &mAllocations, __LINE__);
@@ -1080,6 +1808,8 @@ PLDHashOperator PyXPCOM_AllocHelper::ReadAllocation(void* key,
 PyXPCOM_AllocHelper::~PyXPCOM_AllocHelper() {
 	mAllocations.EnumerateRead(ReadAllocation, nullptr);
 	MOZ_ASSERT(mAllocations.Count() == 0, "Did not free some things");
+	if (mArena)
+		mArena->Reset(mArenaMark);
 }
 
 // Debugging helper; never called in code.  This will leak.
@@ -1168,6 +1898,8 @@ PyXPCOM_InterfaceVariantHelper::PyXPCOM_InterfaceVariantHelper(Py_nsISupports *p
 	// Parent should never die before we do, but let's not take the chance.
 	m_parent = parent;
 	Py_INCREF(parent);
+	// Buffers for 'in' params only live as long as we do.
+	UseCallArena();
 }
 
 PyXPCOM_InterfaceVariantHelper::~PyXPCOM_InterfaceVariantHelper()
@@ -1220,10 +1952,58 @@ PyXPCOM_InterfaceVariantHelper::~PyXPCOM_InterfaceVariantHelper()
 	}
 }
 
+/**
+ * Parse the Python type descriptors for a method.
+ * @param typedescs a sequence of type descriptor tuples, of elements
+ * 		(param_flags, type_flags, argnum, argnum2, iid, array_type).
+ * 		See xpcom/client/__init__.py _ParseMethodSpec for details.
+ * @param descs receives one PythonTypeDescriptor per element
+ * @param min_num_params, max_num_params receive the number of (non-hidden)
+ * 		args that may be passed when calling with these descriptors.
+ */
+bool PyXPCOM_ParseTypeDescriptors(PyObject *typedescs,
+                                  nsTArray<PythonTypeDescriptor> &descs,
+                                  int *min_num_params, int *max_num_params)
+{
+	MOZ_ASSERT(PyGILState_GetThisThreadState());
+	Py_ssize_t numParams = PySequence_Length(typedescs);
+	if (numParams < 0)
+		return false;
+	descs.SetLength(numParams);
+
+	// Pull apart the type descs and stash them.
+	for (Py_ssize_t i = 0; i < numParams; i++) {
+		PyObject *desc_object = PySequence_GetItem(typedescs, i);
+		if (!desc_object)
+			return false;
+
+		// Pull apart the typedesc tuple back into a structure we can work with.
+		PyObject *obIID; // This doesn't hold a ref
+		PythonTypeDescriptor &ptd = descs[i];
+		// Array-of-array is not supported; use it as a sentiel
+		ptd.array_type = nsXPTType::T_ARRAY;
+		bool this_ok = PyArg_ParseTuple(desc_object, "bbbbO|b:type_desc",
+		                                &ptd.param_flags, &ptd.type_flags,
+		                                &ptd.argnum, &ptd.argnum2,
+		                                &obIID, &ptd.array_type);
+		Py_DECREF(desc_object);
+		if (!this_ok)
+			return false;
+
+		// The .py code may send a 0 as the IID!
+		if (obIID != Py_None && !PyInt_Check(obIID)) {
+			if (!Py_nsIID::IIDFromPyObject(obIID, &ptd.iid))
+				return false;
+		}
+	}
+	return ProcessPythonTypeDescriptors(descs.Elements(), descs.Length(),
+	                                    min_num_params, max_num_params);
+}
+
 /**
  * Set up the call information from Python
  * @param obParams the Python call arguments; see xpcom/client/__init__.py
- * 		_MakeMethodCode for details.  It should be a sequence of two tuples;
+ * 		_ParseMethodSpec for details.  It should be a sequence of two tuples;
  * 		the first is the types, and the second is the arguments being passed.
  * 		Each element in the tuple of types is itself a tuple, of elements
  * 		(param_flags, type_flags, argnum, argnum2, iid, array_type).
@@ -1231,10 +2011,8 @@ PyXPCOM_InterfaceVariantHelper::~PyXPCOM_InterfaceVariantHelper()
 bool PyXPCOM_InterfaceVariantHelper::Init(PyObject *obParams)
 {
 	bool ok = false;
-	int i;
 	int min_num_params = 0;
 	int max_num_params = 0;
-	int num_args_provided;
 	MOZ_ASSERT(PyGILState_GetThisThreadState());
 	if (!PySequence_Check(obParams) || PySequence_Length(obParams) != 2) {
 		PyErr_Format(PyExc_TypeError, "Param descriptors must be a sequence of exactly length 2");
@@ -1247,46 +2025,57 @@ bool PyXPCOM_InterfaceVariantHelper::Init(PyObject *obParams)
 	// args actually passed.  The typedescs always include all
 	// hidden params (such as "size_is"), while the actual 
 	// args never include this.
-	Py_ssize_t numParams = PySequence_Length(typedescs);
-	if (PyErr_Occurred()) goto done;
-	mPyTypeDesc.SetLength(numParams);
+	if (!PyXPCOM_ParseTypeDescriptors(typedescs, mPyTypeDesc,
+	                                  &min_num_params, &max_num_params))
+		goto done;
 
 	m_pyparams = PySequence_GetItem(obParams, 1);
 	if (!m_pyparams) goto done;
 
-	// Pull apart the type descs and stash them.
-	for (i = 0; i < numParams; i++) {
-		PyObject *desc_object = PySequence_GetItem(typedescs, i);
-		if (!desc_object)
-			goto done;
+	ok = InitDispatchParams(min_num_params, max_num_params);
+done:
+	if (!ok && !PyErr_Occurred())
+		PyErr_NoMemory();
 
-		// Pull apart the typedesc tuple back into a structure we can work with.
-		PyObject *obIID; // This doesn't hold a ref
-		PythonTypeDescriptor &ptd = mPyTypeDesc[i];
-		// Array-of-array is not supported; use it as a sentiel
-		ptd.array_type = nsXPTType::T_ARRAY;
-		bool this_ok = PyArg_ParseTuple(desc_object, "bbbbO|b:type_desc",
-		                                &ptd.param_flags, &ptd.type_flags,
-		                                &ptd.argnum, &ptd.argnum2,
-		                                &obIID, &ptd.array_type);
-		Py_DECREF(desc_object);
-		if (!this_ok) goto done;
+	Py_XDECREF(typedescs);
+	return ok;
+}
 
-		// The .py code may send a 0 as the IID!
-		if (obIID != Py_None && !PyInt_Check(obIID)) {
-			if (!Py_nsIID::IIDFromPyObject(obIID, &ptd.iid))
-				goto done;
-		}
+/**
+ * Set up the call information from a pre-built method signature.
+ * @param signature the compiled type descriptors for the method.
+ * @param obArgs the sequence of arguments being passed.
+ */
+bool PyXPCOM_InterfaceVariantHelper::Init(PyXPCOM_MethodSignature *signature,
+                                          PyObject *obArgs)
+{
+	MOZ_ASSERT(PyGILState_GetThisThreadState());
+	MOZ_ASSERT(signature);
+	if (!PySequence_Check(obArgs)) {
+		PyErr_Format(PyExc_TypeError, "Method args must be a sequence (got %s)",
+		             obArgs->ob_type->tp_name);
+		return false;
 	}
-	ok = ProcessPythonTypeDescriptors(mPyTypeDesc.Elements(), mPyTypeDesc.Length(),
-	                                  &min_num_params, &max_num_params);
-	if (!ok) {
-		goto done;
+	// The signature's descriptors have already been processed; copying
+	// them gives us fresh per-call state (have_set_auto etc).
+	if (!mPyTypeDesc.AppendElements(signature->mPyTypeDesc)) {
+		PyErr_NoMemory();
+		return false;
 	}
+	m_pyparams = obArgs;
+	Py_INCREF(m_pyparams);
+	return InitDispatchParams(signature->m_min_num_params,
+	                          signature->m_max_num_params);
+}
 
+bool PyXPCOM_InterfaceVariantHelper::InitDispatchParams(int min_num_params,
+                                                        int max_num_params)
+{
 	// OK - check we got the number of args we expected.
 	// If not, its really an internal error rather than the user.
-	num_args_provided = PySequence_Length(m_pyparams);
+	int num_args_provided = PySequence_Length(m_pyparams);
+	if (num_args_provided < 0)
+		return false;
 	if ((num_args_provided < min_num_params) || (num_args_provided > max_num_params)) {
 		if (min_num_params == max_num_params) {
 			PyErr_Format(PyExc_ValueError,
@@ -1297,29 +2086,19 @@ bool PyXPCOM_InterfaceVariantHelper::Init(PyObject *obParams)
 			             "The type descriptions indicate between %d to %d args are needed, but %d were provided",
 			             min_num_params, max_num_params, num_args_provided);
 		}
-		ok = false;
-		goto done;
+		return false;
 	}
 
 	// Init the parameters to pass to XPCOM
-	mDispatchParams.SetLength(numParams);
+	mDispatchParams.SetLength(mPyTypeDesc.Length());
 	// We need to initialize params
-	{ /* scope */
-		nsXPTCMiniVariant mv;
-		memset(&mv, 0, sizeof(mv));
-		for (Py_ssize_t i = 0; i < numParams; ++i) {
-			mDispatchParams[i].Init(mv, nsXPTType::T_VOID, 0);
-			MOZ_ASSERT(!mDispatchParams[i].val.p);
-		}
+	nsXPTCMiniVariant mv;
+	memset(&mv, 0, sizeof(mv));
+	for (uint32_t i = 0; i < mDispatchParams.Length(); ++i) {
+		mDispatchParams[i].Init(mv, nsXPTType::T_VOID, 0);
+		MOZ_ASSERT(!mDispatchParams[i].val.p);
 	}
-
-	ok = true;
-done:
-	if (!ok && !PyErr_Occurred())
-		PyErr_NoMemory();
-
-	Py_XDECREF(typedescs);
-	return ok;
+	return true;
 }
 
 
@@ -1587,7 +2366,7 @@ bool PyXPCOM_InterfaceVariantHelper::FillInVariant(const PythonTypeDescriptor &t
 
 	  case TD_PNSIID: {
 		nsIID *iid;
-		if (!Alloc(iid, 1, __FILE__, __LINE__)) {
+		if (!AllocInParam(iid, 1, td, __FILE__, __LINE__)) {
 			PyErr_NoMemory();
 			BREAK_FALSE;
 		}
@@ -1676,7 +2455,7 @@ bool PyXPCOM_InterfaceVariantHelper::FillInVariant(const PythonTypeDescriptor &t
 		MOZ_ASSERT(PyString_Check(val_use), "PyObject_Str didn't return a string object!");
 
 		char* str;
-		if (!Alloc(str, PyString_GET_SIZE(val_use) + 1, __FILE__, __LINE__)) {
+		if (!AllocInParam(str, PyString_GET_SIZE(val_use) + 1, td, __FILE__, __LINE__)) {
 			PyErr_NoMemory();
 			BREAK_FALSE;
 		}
@@ -1766,7 +2545,7 @@ bool PyXPCOM_InterfaceVariantHelper::FillInVariant(const PythonTypeDescriptor &t
 
 		char* str;
 		const Py_ssize_t size = PyString_GET_SIZE(val_use);
-		if (!Alloc(str, size + 1, __FILE__, __LINE__)) {
+		if (!AllocInParam(str, size + 1, td, __FILE__, __LINE__)) {
 			PyErr_NoMemory();
 			BREAK_FALSE;
 		}
@@ -1817,7 +2596,7 @@ bool PyXPCOM_InterfaceVariantHelper::FillInVariant(const PythonTypeDescriptor &t
 
 		PRUint32 element_size = GetArrayElementSize(td.ArrayTypeTag());
 		Py_ssize_t seq_length = PySequence_Length(val);
-		ns_v.val.p = Alloc(element_size, seq_length, __FILE__, __LINE__);
+		ns_v.val.p = AllocInParam(element_size, seq_length, td, __FILE__, __LINE__);
 		if (!ns_v.val.p) {
 			PyErr_NoMemory();
 			BREAK_FALSE;
@@ -2251,9 +3030,18 @@ PyObject *PyXPCOM_InterfaceVariantHelper::MakeSinglePythonResult(int index)
 				default:
 					iid = nullptr;
 			}
-			ret = UnpackSingleArray(m_parent,
-			                        *reinterpret_cast<void **>(ns_v.ptr),
-			                        seq_size, array_type, iid);
+			void **pp = reinterpret_cast<void **>(ns_v.ptr);
+			if (PyXPCOM_ArrayResult::CanAdopt(array_type) && !IsArenaMemory(*pp)) {
+				// The result takes over the array, so we mustn't free it.
+				MOZ_ASSERT(ns_v.ptr == &ns_v.val.p);
+				ret = new PyXPCOM_ArrayResult(*pp, seq_size,
+				                              GetArrayElementSize(array_type),
+				                              array_type);
+				MarkFree(*pp);
+				*pp = nullptr;
+			} else
+				ret = UnpackSingleArray(m_parent, *pp, seq_size,
+				                        array_type, iid);
 		}
 		break;
 		}
@@ -3303,7 +4091,6 @@ nsresult PyXPCOM_GatewayVariantHelper::ProcessPythonResult(PyObject *ret_ob)
 	NS_PRECONDITION(!PyErr_Occurred(),
 	                "Expecting no Python exception to be pending when processing the return result");
 
-	nsresult rc = NS_OK;
 	// If we don't get a tuple back, then the result is only
 	// an int nresult for the underlying function.
 	// (ie, the policy is expected to return (NS_OK, user_retval),
@@ -3317,7 +4104,17 @@ nsresult PyXPCOM_GatewayVariantHelper::ProcessPythonResult(PyObject *ret_ob)
 		PyErr_SetString(PyExc_TypeError, "The Python result must be a single integer or a tuple of length==2 and first item an int.");
 		return NS_ERROR_FAILURE;
 	}
-	PyObject *user_result = PyTuple_GET_ITEM(ret_ob, 1);
+	return ProcessUserResult(PyTuple_GET_ITEM(ret_ob, 1));
+}
+
+// Back-fill the [out] params from the value returned by the Python code
+// (ie, the second item of the tuple returned by the policy)
+nsresult PyXPCOM_GatewayVariantHelper::ProcessUserResult(PyObject *user_result)
+{
+	NS_PRECONDITION(!PyErr_Occurred(),
+	                "Expecting no Python exception to be pending when processing the return result");
+
+	nsresult rc = NS_OK;
 	// Count up how many results our function needs.
 	int i;
 	int num_results = 0;
@@ -156,6 +156,47 @@ PyXPCOMMethod_XPTI_GetInterfaceInfoManager(PyObject *self, PyObject *args)
 	return Py_nsISupports::PyObjectFromInterface(im, NS_GET_IID(nsIInterfaceInfoManager), false);
 }
 
+// Get the interface pointer to make a call on from a native wrapper.
+static bool
+GetInvokeTarget(PyObject *obIS, nsISupports **ppis)
+{
+	if (!Py_nsISupports::Check(obIS)) {
+		PyErr_Format(PyExc_TypeError,
+		             "First param must be a native nsISupports wrapper (got %s)",
+		             obIS->ob_type->tp_name);
+		return false;
+	}
+	// Ack!  We must ask for the "native" interface supported by
+	// the object, not specifically nsISupports, else we may not
+	// back the same pointer (eg, Python, following identity rules,
+	// will return the "original" gateway when QI'd for nsISupports)
+	return Py_nsISupports::InterfaceFromPyObject(
+			obIS,
+			Py_nsIID_NULL,
+			ppis,
+			false);
+}
+
+// Make the call described by an initialized helper.
+static PyObject *
+DoInvokeByIndex(nsISupports *pis, int index,
+                PyXPCOM_InterfaceVariantHelper &arg_helper)
+{
+	if (!arg_helper.PrepareCall())
+		return NULL;
+
+	nsresult r;
+	Py_BEGIN_ALLOW_THREADS;
+	r = NS_InvokeByIndex(pis, index,
+	                     arg_helper.mDispatchParams.Length(),
+	                     arg_helper.mDispatchParams.Elements());
+	Py_END_ALLOW_THREADS;
+	if ( NS_FAILED(r) )
+		return PyXPCOM_BuildPyException(r);
+
+	return arg_helper.MakePythonResult();
+}
+
 static PyObject *
 PyXPCOMMethod_NS_InvokeByIndex(PyObject *self, PyObject *args)
 {
@@ -170,39 +211,129 @@ PyXPCOMMethod_NS_InvokeByIndex(PyObject *self, PyObject *args)
 	if (!PyArg_ParseTuple(args, "OiO", &obIS, &index, &obParams))
 		return NULL;
 
-	if (!Py_nsISupports::Check(obIS)) {
+	if (!GetInvokeTarget(obIS, getter_AddRefs(pis)))
+		return NULL;
+
+	PyXPCOM_InterfaceVariantHelper arg_helper((Py_nsISupports *)obIS);
+	if (!arg_helper.Init(obParams))
+		return NULL;
+
+	return DoInvokeByIndex(pis, index, arg_helper);
+}
+
+// Like NS_InvokeByIndex, but takes a MethodSignature object (see
+// PyMethodSignature.cpp) plus the plain argument tuple, so the type
+// descriptors don't need to be re-parsed for every call.
+static PyObject *
+PyXPCOMMethod_NS_InvokeBySignature(PyObject *self, PyObject *args)
+{
+	PyObject *obIS, *obSignature, *obArgs;
+
+	NS_ASSERTION(!PyErr_Occurred(), "Should be no pending Python error!");
+
+	if (!PyArg_ParseTuple(args, "OOO", &obIS, &obSignature, &obArgs))
+		return NULL;
+
+	if (!PyXPCOM_MethodSignature::Check(obSignature)) {
 		return PyErr_Format(PyExc_TypeError,
-		                    "First param must be a native nsISupports wrapper (got %s)",
-		                    obIS->ob_type->tp_name);
+		                    "Second param must be a MethodSignature (got %s)",
+		                    obSignature->ob_type->tp_name);
 	}
-	// Ack!  We must ask for the "native" interface supported by
-	// the object, not specifically nsISupports, else we may not
-	// back the same pointer (eg, Python, following identity rules,
-	// will return the "original" gateway when QI'd for nsISupports)
-	if (!Py_nsISupports::InterfaceFromPyObject(
-			obIS,
-			Py_nsIID_NULL,
-			getter_AddRefs(pis),
-			false))
+	return PyXPCOM_InvokeBySignature(obIS, (PyXPCOM_MethodSignature *)obSignature, obArgs);
+}
+
+PyObject *
+PyXPCOM_InvokeBySignature(PyObject *obIS, PyXPCOM_MethodSignature *signature,
+                          PyObject *obArgs)
+{
+	nsCOMPtr<nsISupports> pis;
+	if (!GetInvokeTarget(obIS, getter_AddRefs(pis)))
 		return NULL;
 
 	PyXPCOM_InterfaceVariantHelper arg_helper((Py_nsISupports *)obIS);
-	if (!arg_helper.Init(obParams))
+	if (!arg_helper.Init(signature, obArgs))
 		return NULL;
 
-	if (!arg_helper.PrepareCall())
+	return DoInvokeByIndex(pis, signature->m_methodIndex, arg_helper);
+}
+
+// Fast paths for attribute access from xpcom.client; these take the
+// signature of the attribute's getter or setter method, and avoid
+// building the argument tuples in Python.
+static PyObject *
+PyXPCOMMethod_NS_GetPropertyBySignature(PyObject *self, PyObject *args)
+{
+	PyObject *obIS, *obSignature;
+	nsCOMPtr<nsISupports> pis;
+
+	NS_ASSERTION(!PyErr_Occurred(), "Should be no pending Python error!");
+
+	if (!PyArg_ParseTuple(args, "OO", &obIS, &obSignature))
 		return NULL;
 
-	nsresult r;
-	Py_BEGIN_ALLOW_THREADS;
-	r = NS_InvokeByIndex(pis, index,
-	                     arg_helper.mDispatchParams.Length(),
-	                     arg_helper.mDispatchParams.Elements());
-	Py_END_ALLOW_THREADS;
-	if ( NS_FAILED(r) )
-		return PyXPCOM_BuildPyException(r);
+	if (!PyXPCOM_MethodSignature::Check(obSignature)) {
+		return PyErr_Format(PyExc_TypeError,
+		                    "Second param must be a MethodSignature (got %s)",
+		                    obSignature->ob_type->tp_name);
+	}
+	PyXPCOM_MethodSignature *signature = (PyXPCOM_MethodSignature *)obSignature;
+	if (signature->mPyTypeDesc.Length() != 1) { // Only expecting a retval
+		PyErr_SetString(PyExc_RuntimeError,
+		                "Can't get properties with this many args!");
+		return NULL;
+	}
 
-	return arg_helper.MakePythonResult();
+	if (!GetInvokeTarget(obIS, getter_AddRefs(pis)))
+		return NULL;
+
+	PyObject *obArgs = PyTuple_New(0); // This is a shared singleton
+	if (!obArgs)
+		return NULL;
+	PyXPCOM_InterfaceVariantHelper arg_helper((Py_nsISupports *)obIS);
+	bool ok = arg_helper.Init(signature, obArgs);
+	Py_DECREF(obArgs);
+	if (!ok)
+		return NULL;
+
+	return DoInvokeByIndex(pis, signature->m_methodIndex, arg_helper);
+}
+
+static PyObject *
+PyXPCOMMethod_NS_SetPropertyBySignature(PyObject *self, PyObject *args)
+{
+	PyObject *obIS, *obSignature, *obValue;
+	nsCOMPtr<nsISupports> pis;
+
+	NS_ASSERTION(!PyErr_Occurred(), "Should be no pending Python error!");
+
+	if (!PyArg_ParseTuple(args, "OOO", &obIS, &obSignature, &obValue))
+		return NULL;
+
+	if (!PyXPCOM_MethodSignature::Check(obSignature)) {
+		return PyErr_Format(PyExc_TypeError,
+		                    "Second param must be a MethodSignature (got %s)",
+		                    obSignature->ob_type->tp_name);
+	}
+	PyXPCOM_MethodSignature *signature = (PyXPCOM_MethodSignature *)obSignature;
+	if (signature->mPyTypeDesc.Length() != 1) { // Only expecting a single input val
+		PyErr_SetString(PyExc_RuntimeError,
+		                "Can't set properties with this many args!");
+		return NULL;
+	}
+
+	if (!GetInvokeTarget(obIS, getter_AddRefs(pis)))
+		return NULL;
+
+	PyObject *obArgs = PyTuple_Pack(1, obValue);
+	if (!obArgs)
+		return NULL;
+	PyXPCOM_InterfaceVariantHelper arg_helper((Py_nsISupports *)obIS);
+	bool ok = arg_helper.Init(signature, obArgs);
+	Py_DECREF(obArgs);
+	if (!ok)
+		return NULL;
+
+	return DoInvokeByIndex(pis, signature->m_methodIndex, arg_helper);
 }
 
 /**
@@ -301,6 +432,9 @@ PyXPCOMMethod_NS_ShutdownXPCOM(PyObject *self, PyObject *args)
 	Py_BEGIN_ALLOW_THREADS;
 	nr = NS_ShutdownXPCOM(nullptr);
 	Py_END_ALLOW_THREADS;
+	// Normally done by the xpcom-shutdown observer, but we may not have
+	// had one registered.
+	PyXPCOM_ShutdownCaches();
 	// NS_ShutdownXPCOM will dispose of various services, so that might
 	// itself release some things.  Only check for clean shutdown afterwards.
 	MOZ_ASSERT(_PyXPCOM_GetInterfaceCount() == 0);
@@ -311,6 +445,51 @@ PyXPCOMMethod_NS_ShutdownXPCOM(PyObject *self, PyObject *args)
 	return PyInt_FromLong(static_cast<uint32_t>(nr));
 }
 
+// Drop the native caches of type library data; called from the
+// xpcom-shutdown observer (see xpcom.components)
+void PyXPCOM_ShutdownCaches()
+{
+	PyXPCOM_ShutdownMethodDescriptorCache();
+	PyXPCOM_ShutdownComponentCache();
+	PyXPCOM_ShutdownVariantFreeList();
+}
+
+static PyObject *
+PyXPCOMMethod_ShutdownCaches(PyObject *self, PyObject *args)
+{
+	if (!PyArg_ParseTuple(args, ":_ShutdownCaches"))
+		return NULL;
+	PyXPCOM_ShutdownCaches();
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+// @pymethod bool|pythoncom|SetIdentityCacheEnabled|Sets whether an object returned to Python more than once gets the same wrapper.
+static PyObject *
+PyXPCOMMethod_SetIdentityCacheEnabled(PyObject *self, PyObject *args)
+{
+	// @comm When enabled, returning an object which already has a live
+	// Component for the same interface returns that Component, rather
+	// than building a new one.  The previous setting is returned.
+	int bEnable;
+	if (!PyArg_ParseTuple(args, "i:SetIdentityCacheEnabled", &bEnable))
+		return NULL;
+	return PyBool_FromLong(PyXPCOM_SetIdentityCacheEnabled(bEnable != 0));
+}
+
+// @pymethod bool|pythoncom|SetBufferArrayResults|Sets whether numeric arrays are returned as buffers rather than lists.
+static PyObject *
+PyXPCOMMethod_SetBufferArrayResults(PyObject *self, PyObject *args)
+{
+	// @comm When enabled, a numeric array returned by an XPCOM method is
+	// returned as a read-only sequence owning the array's memory, which
+	// supports the buffer interface.  The previous setting is returned.
+	int bEnable;
+	if (!PyArg_ParseTuple(args, "i:SetBufferArrayResults", &bEnable))
+		return NULL;
+	return PyBool_FromLong(PyXPCOM_SetBufferArrayResults(bEnable != 0));
+}
+
 static PyObject *
 PyXPCOMMethod_MakeVariant(PyObject *self, PyObject *args)
 {
@@ -490,6 +669,8 @@ PyObject *PyXPCOMMethod__Break(PyObject *self, PyObject *args)
 #endif /* DEBUG */
 
 extern PyObject *PyXPCOMMethod_IID(PyObject *self, PyObject *args);
+extern PyObject *PyXPCOMMethod_MakeMethodSignature(PyObject *self, PyObject *args);
+extern PyObject *PyXPCOMMethod_MakeMethod(PyObject *self, PyObject *args);
 
 static struct PyMethodDef xpcom_methods[]=
 {
@@ -497,6 +678,11 @@ static struct PyMethodDef xpcom_methods[]=
 	{"GetComponentRegistrar", PyXPCOMMethod_GetComponentRegistrar, 1},
 	{"XPTI_GetInterfaceInfoManager", PyXPCOMMethod_XPTI_GetInterfaceInfoManager, 1},
 	{"NS_InvokeByIndex", PyXPCOMMethod_NS_InvokeByIndex, 1},
+	{"NS_InvokeBySignature", PyXPCOMMethod_NS_InvokeBySignature, 1},
+	{"NS_GetPropertyBySignature", PyXPCOMMethod_NS_GetPropertyBySignature, 1},
+	{"NS_SetPropertyBySignature", PyXPCOMMethod_NS_SetPropertyBySignature, 1},
+	{"MakeMethodSignature", PyXPCOMMethod_MakeMethodSignature, 1},
+	{"MakeMethod", PyXPCOMMethod_MakeMethod, 1},
 	{"GetServiceManager", PyXPCOMMethod_GetServiceManager, 1},
 	{"IID", PyXPCOMMethod_IID, 1}, // IID is wrong - deprecated - not just IID, but CID, etc.
 	{"ID", PyXPCOMMethod_IID, 1}, // This is the official name.
@@ -505,6 +691,9 @@ static struct PyMethodDef xpcom_methods[]=
 	{"UnwrapObject", PyXPCOMMethod_UnwrapObject, 1},
 	{"_GetInterfaceCount", PyXPCOMMethod_GetInterfaceCount, 1},
 	{"_GetGatewayCount", PyXPCOMMethod_GetGatewayCount, 1},
+	{"_ShutdownCaches", PyXPCOMMethod_ShutdownCaches, 1},
+	{"SetIdentityCacheEnabled", PyXPCOMMethod_SetIdentityCacheEnabled, 1},
+	{"SetBufferArrayResults", PyXPCOMMethod_SetBufferArrayResults, 1},
 	{"GetSpecialDirectory", PyGetSpecialDirectory, 1},
 	{"AllocateBuffer", AllocateBuffer, 1},
 	{"LogConsoleMessage", LogConsoleMessage, 1, "Write a message to the xpcom console service"},
@@ -65,6 +65,9 @@
 #endif
 
 static PRLock *g_lockMain = nullptr;
+// Striped per-object locks - must be a power of 2.
+#define NUM_OBJECT_LOCKS 64
+static PRLock *g_objectLocks[NUM_OBJECT_LOCKS];
 
 PyObject *PyXPCOM_Error = NULL;
 bool PyXPCOM_ModuleInitialized = false;
@@ -95,6 +98,29 @@ PyXPCOM_ReleaseGlobalLock(void)
 	PR_Unlock(g_lockMain);
 }
 
+static inline PRLock *
+GetObjectLock(const void *key)
+{
+	// Objects are at least 8 byte aligned, so ignore the low bits.
+	uintptr_t bits = reinterpret_cast<uintptr_t>(key);
+	bits ^= bits >> 9;
+	return g_objectLocks[(bits >> 3) & (NUM_OBJECT_LOCKS - 1)];
+}
+
+void
+PyXPCOM_AcquireObjectLock(const void *key)
+{
+	NS_PRECONDITION(key != nullptr, "Cant lock a NULL object!");
+	PR_Lock(GetObjectLock(key));
+}
+
+void
+PyXPCOM_ReleaseObjectLock(const void *key)
+{
+	NS_PRECONDITION(key != nullptr, "Cant unlock a NULL object!");
+	PR_Unlock(GetObjectLock(key));
+}
+
 // Ensure that any paths guaranteed by this package exist on sys.path
 // Only called once as we are first loaded into the process.
 void AddStandardPaths()
@@ -245,11 +271,15 @@ void pyxpcom_construct(void)
 	// Create the lock we will use to ensure startup thread
 	// safetly, but don't actually initialize Python yet.
 	g_lockMain = PR_NewLock();
+	for (int i = 0; i < NUM_OBJECT_LOCKS; i++)
+		g_objectLocks[i] = PR_NewLock();
 	return; // true;
 }
 
 void pyxpcom_destruct(void)
 {
+	for (int i = 0; i < NUM_OBJECT_LOCKS; i++)
+		PR_DestroyLock(g_objectLocks[i]);
 	PR_DestroyLock(g_lockMain);
 }
 
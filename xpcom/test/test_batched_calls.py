@@ -0,0 +1,51 @@
+#
+# test_batched_calls.py
+# Check that objects setting _com_batch_calls_ have their notification style
+# calls queued and delivered from the event loop.
+#
+
+from xpcom import components
+import xpcom.server
+from pyxpcom_test_tools import testmain
+import unittest
+
+class Observer:
+    _com_interfaces_ = [components.interfaces.nsIObserver]
+    _com_batch_calls_ = True
+    def __init__(self):
+        self.calls = []
+    def observe(self, subject, topic, data):
+        if topic == "fail":
+            raise ValueError("this call fails")
+        self.calls.append((topic, data))
+
+def spinEventLoop():
+    thread = components.classes["@mozilla.org/thread-manager;1"]\
+                       .getService(components.interfaces.nsIThreadManager)\
+                       .currentThread
+    while thread.hasPendingEvents():
+        thread.processNextEvent(False)
+
+class TestBatchedCalls(unittest.TestCase):
+    def testBatched(self):
+        ob = Observer()
+        observer = xpcom.server.WrapObject(ob, components.interfaces.nsIObserver)
+        for i in range(3):
+            observer.observe(None, "topic", str(i))
+        # Nothing delivered until the event loop runs.
+        self.failUnlessEqual(ob.calls, [])
+        spinEventLoop()
+        self.failUnlessEqual(ob.calls, [("topic", "0"), ("topic", "1"), ("topic", "2")])
+
+    def testErrors(self):
+        ob = Observer()
+        observer = xpcom.server.WrapObject(ob, components.interfaces.nsIObserver)
+        observer.observe(None, "topic", "before")
+        # The caller can't see the failure - it is only logged.
+        observer.observe(None, "fail", None)
+        observer.observe(None, "topic", "after")
+        spinEventLoop()
+        self.failUnlessEqual(ob.calls, [("topic", "before"), ("topic", "after")])
+
+if __name__=='__main__':
+    testmain()
@@ -41,7 +41,9 @@ import xpcom.client
 import xpcom.server
 import xpcom._xpcom
 import xpcom.components
+import xpcom.xpt
 import string
+import weakref
 from pyxpcom_test_tools import testmain
 
 import unittest
@@ -108,6 +110,26 @@ class TestEnumContractIDs(unittest.TestCase):
         if n < 200:
             print "Only found", n, "ContractIDs - this seems unusually low!"
 
+    def testIterate(self):
+        """Iterate over the ContractIDs, natively and via hasMoreElements"""
+        expected = []
+        enum = xpcom.components.registrar.enumerateContractIDs()
+        while enum.hasMoreElements():
+            item = enum.getNext(xpcom.components.interfaces.nsISupportsCString)
+            expected.append(item.data)
+        enum = xpcom.components.registrar.enumerateContractIDs()
+        got = [item.data for item in enum.iterate(xpcom.components.interfaces.nsISupportsCString)]
+        self.failUnlessEqual(got, expected)
+        # Plain iteration gives nsISupports objects.
+        enum = xpcom.components.registrar.enumerateContractIDs()
+        items = list(enum)
+        self.failUnlessEqual(len(items), len(expected))
+        item = items[0].QueryInterface(xpcom.components.interfaces.nsISupportsCString)
+        self.failUnlessEqual(item.data, expected[0])
+        # An exhausted iterator stays exhausted.
+        it = iter(enum)
+        self.failUnlessRaises(StopIteration, it.next)
+
 class TestSampleComponent(unittest.TestCase):
     def _doTestSampleComponent(self, test_flat = 0):
         """Test the standard Netscape 'sample' sample"""
@@ -282,5 +304,362 @@ class TestDirInterfaces(unittest.TestCase):
                    .createInstance(xpcom.components.interfaces.nsISupportsInterfacePointer)
         self.assertIn("dataIID", dir(sip))
 
+class TestMethodSignature(unittest.TestCase):
+    def _getSignature(self, iid, name):
+        interface = xpcom.xpt.Interface(iid)
+        for method in interface.methods:
+            if method.name == name:
+                spec = xpcom.client._MakeMethodSpec(method)
+                param_flags = xpcom.client._ParseMethodSpec(spec)[0]
+                return xpcom._xpcom.MakeMethodSignature(iid, method.method_index,
+                                                        param_flags)
+        self.fail("No method %s" % (name,))
+
+    def testSignature(self):
+        iid = xpcom.components.interfaces.nsISupportsCString
+        sig = self._getSignature(iid, "toString")
+        self.failUnlessEqual(sig.iid, iid)
+        self.failUnlessEqual(sig.min_args, 0)
+        self.failUnlessEqual(sig.max_args, 0)
+
+    def testInvoke(self):
+        ob = xpcom.components.classes["@mozilla.org/supports-cstring;1"]\
+                  .createInstance(xpcom.components.interfaces.nsISupportsCString)
+        ob.data = "hello"
+        self.failUnlessEqual(ob.toString(), "hello")
+        sig = self._getSignature(xpcom.components.interfaces.nsISupportsCString,
+                                 "toString")
+        self.failUnlessEqual(xpcom._xpcom.NS_InvokeBySignature(ob._comobj_, sig, ()),
+                             "hello")
+        # Too many args is an error, as for NS_InvokeByIndex
+        self.failUnlessRaises(ValueError, xpcom._xpcom.NS_InvokeBySignature,
+                              ob._comobj_, sig, (1,))
+        self.failUnlessRaises(TypeError, xpcom._xpcom.NS_InvokeBySignature,
+                              ob._comobj_, None, ())
+
+    def testProperties(self):
+        iid = xpcom.components.interfaces.nsISupportsCString
+        ob = xpcom.components.classes["@mozilla.org/supports-cstring;1"]\
+                  .createInstance(iid)
+        getters, setters = xpcom.client.BuildInterfaceInfo(iid)[1:3]
+        xpcom._xpcom.NS_SetPropertyBySignature(ob._comobj_, setters["data"], "foo")
+        self.failUnlessEqual(xpcom._xpcom.NS_GetPropertyBySignature(ob._comobj_, getters["data"]),
+                             "foo")
+        self.failUnlessEqual(ob.data, "foo")
+        # A signature without exactly one param can't set a property
+        sig = xpcom._xpcom.MakeMethodSignature(iid, 3, ())
+        self.failUnlessRaises(RuntimeError, xpcom._xpcom.NS_SetPropertyBySignature,
+                              ob._comobj_, sig, "bar")
+        # toString's only param is its result, so it takes no args
+        sig = self._getSignature(iid, "toString")
+        self.failUnlessRaises(ValueError, xpcom._xpcom.NS_SetPropertyBySignature,
+                              ob._comobj_, sig, "bar")
+
+class TestMethod(unittest.TestCase):
+    def setUp(self):
+        self.ob = xpcom.components.classes["@mozilla.org/supports-string;1"]\
+                       .createInstance(xpcom.components.interfaces.nsISupportsString)
+
+    def testCall(self):
+        self.ob.data = u"hello"
+        method = self.ob.toString
+        self.failUnlessEqual(method.__name__, "toString")
+        self.failUnlessEqual(method(), u"hello")
+        self.failUnlessRaises(TypeError, method, 1)
+
+    def testArgs(self):
+        svc = xpcom.components.classes["@mozilla.org/observer-service;1"]\
+                   .getService(xpcom.components.interfaces.nsIObserverService)
+        method = svc.notifyObservers.im_func
+        self.failUnlessEqual(method.arg_names, ("Param1", "Param2", "Param3"))
+        # Args can be passed by name.
+        svc.notifyObservers(None, Param2="pyxpcom-test-method", Param3=u"data")
+        self.failUnlessRaises(TypeError, svc.notifyObservers, None)
+        self.failUnlessRaises(TypeError, svc.notifyObservers, None, "topic", None, None)
+        self.failUnlessRaises(TypeError, svc.notifyObservers, None, "topic", Foo=1)
+        self.failUnlessRaises(TypeError, svc.notifyObservers, None, "topic", Param1=None)
+
+class TestInfoCache(unittest.TestCase):
+    def testRoundTrip(self):
+        import os, tempfile
+        from xpcom.client import infocache
+        fd, name = tempfile.mkstemp()
+        os.close(fd)
+        os.remove(name)
+        old_filename = infocache._filename
+        old_override = infocache.build_id_override
+        try:
+            # Don't depend on nsIXULAppInfo, which the test harness lacks.
+            infocache.build_id_override = "test-build-1"
+            iid = xpcom.components.interfaces.nsISupportsCString
+            entry = xpcom.client._BuildInterfaceEntry(iid)
+            infocache.Enable(name)
+            infocache.Store(iid, entry)
+            self.failUnlessEqual(infocache._build_id, "test-build-1")
+            infocache.Save()
+            self.failUnless(os.path.exists(name))
+            # Read it back.
+            infocache.Enable(name)
+            self.failUnlessEqual(infocache.Lookup(iid), entry)
+            # An entry which doesn't match the interface is discarded.
+            infocache.Store(iid, (entry[0] + 1,) + entry[1:])
+            self.failUnless(infocache.Lookup(iid) is None)
+            # A file written by another build is ignored.
+            infocache.Enable(name)
+            infocache.Store(iid, entry)
+            infocache.Save()
+            infocache.build_id_override = "test-build-2"
+            infocache.Enable(name)
+            self.failUnless(infocache.Lookup(iid) is None)
+            infocache.build_id_override = "test-build-1"
+            infocache.Enable(name)
+            self.failUnlessEqual(infocache.Lookup(iid), entry)
+        finally:
+            infocache.build_id_override = old_override
+            infocache.Enable(old_filename)
+            if os.path.exists(name):
+                os.remove(name)
+
+class TestGatewayMethodInfo(unittest.TestCase):
+    def testShared(self):
+        # The method info tuple handed to the policy is built once per method.
+        infos = []
+        class RecordingPolicy(xpcom.server.DefaultPolicy):
+            def _CallMethod_(self, com_object, index, info, params):
+                infos.append(info)
+                return xpcom.server.DefaultPolicy._CallMethod_(self, com_object, index, info, params)
+        class Observer:
+            _com_interfaces_ = [xpcom.components.interfaces.nsIObserver]
+            def observe(self, subject, topic, data):
+                pass
+        ob = xpcom.server.WrapObject(Observer(), xpcom.components.interfaces.nsIObserver,
+                                     policy=RecordingPolicy)
+        ob.observe(None, "topic", None)
+        ob.observe(None, "topic", None)
+        self.failUnlessEqual(len(infos), 2)
+        self.failUnless(infos[0] is infos[1])
+        self.failUnlessEqual(infos[0][1], "observe")
+
+class TestReturnedComponents(unittest.TestCase):
+    def testLazyComponent(self):
+        iid = xpcom.components.interfaces.nsISupportsCString
+        sip = xpcom.components.classes["@mozilla.org/supports-interface-pointer;1"]\
+                   .createInstance(xpcom.components.interfaces.nsISupportsInterfacePointer)
+        sip.dataIID = iid
+        sip.data = xpcom.components.classes["@mozilla.org/supports-cstring;1"]\
+                        .createInstance(iid)
+        # An interface returned from a native call.
+        ob = sip.data
+        self.failUnless(isinstance(ob, xpcom.client.Component))
+        # The interface is only reflected on first use.
+        self.failUnless('_pending_iid_' in ob.__dict__)
+        ob.data = "hello"
+        self.failIf('_pending_iid_' in ob.__dict__)
+        self.failUnlessEqual(ob.data, "hello")
+        self.failUnlessEqual(str(ob), "hello")
+        self.failUnless(ob.nsISupportsCString is not None)
+        self.failUnless("nsISupportsCString" in repr(sip.data))
+
+    def testMakeInterfaceResultHook(self):
+        # Replacing xpcom.client.MakeInterfaceResult still sees every result.
+        results = []
+        def hook(ob, iid):
+            results.append(iid)
+            return xpcom.client._DefaultMakeInterfaceResult(ob, iid)
+        sip = xpcom.components.classes["@mozilla.org/supports-interface-pointer;1"]\
+                   .createInstance(xpcom.components.interfaces.nsISupportsInterfacePointer)
+        sip.dataIID = xpcom.components.interfaces.nsISupportsCString
+        sip.data = xpcom.components.classes["@mozilla.org/supports-cstring;1"]\
+                        .createInstance(xpcom.components.interfaces.nsISupportsCString)
+        xpcom.client.MakeInterfaceResult = hook
+        try:
+            ob = sip.data
+        finally:
+            xpcom.client.MakeInterfaceResult = xpcom.client._DefaultMakeInterfaceResult
+        self.failUnlessEqual(results, [xpcom.components.interfaces.nsISupportsCString])
+        self.failIf('_pending_iid_' in ob.__dict__)
+        ob = sip.data
+        self.failUnless('_pending_iid_' in ob.__dict__)
+
+    def testIdentityCache(self):
+        iid = xpcom.components.interfaces.nsISupportsCString
+        sip = xpcom.components.classes["@mozilla.org/supports-interface-pointer;1"]\
+                   .createInstance(xpcom.components.interfaces.nsISupportsInterfacePointer)
+        sip.dataIID = iid
+        sip.data = xpcom.components.classes["@mozilla.org/supports-cstring;1"]\
+                        .createInstance(iid)
+        self.failIf(sip.data is sip.data)
+        old = xpcom._xpcom.SetIdentityCacheEnabled(True)
+        try:
+            ob = sip.data
+            self.failUnless(sip.data is ob)
+            ob.data = "hello"
+            self.failUnlessEqual(sip.data.data, "hello")
+            # The cache holds no reference to the wrapper.
+            ref = weakref.ref(ob)
+            del ob
+            self.failUnless(ref() is None)
+            self.failUnlessEqual(sip.data.data, "hello")
+        finally:
+            xpcom._xpcom.SetIdentityCacheEnabled(old)
+        self.failIf(sip.data is sip.data)
+
+class TestIdentity(unittest.TestCase):
+    def testIdentity(self):
+        cs = xpcom.components.classes["@mozilla.org/supports-cstring;1"]\
+                  .createInstance(xpcom.components.interfaces.nsISupportsCString)
+        other = xpcom.components.classes["@mozilla.org/supports-cstring;1"]\
+                     .createInstance(xpcom.components.interfaces.nsISupportsCString)
+        raw = cs._comobj_
+        sup = raw.queryInterface(xpcom.components.interfaces.nsISupports, 0)
+        prim = raw.queryInterface(xpcom.components.interfaces.nsISupportsPrimitive, 0)
+        # The raw interfaces, for different IIDs, are the same object.
+        self.failUnless(sup == prim)
+        self.failIf(sup != prim)
+        self.failUnlessEqual(hash(sup), hash(prim))
+        self.failUnless(raw != other._comobj_)
+        # As are the Components.
+        self.failUnless(cs == sup)
+        self.failIf(cs != sup)
+        self.failUnless(cs != other)
+        d = {cs: 1, other: 2}
+        self.failUnlessEqual(d[prim], 1)
+        self.failUnlessEqual(d[other._comobj_], 2)
+        self.failUnlessEqual(len(set([cs, sup, prim, raw])), 1)
+
+class TestVariantParams(unittest.TestCase):
+    def testSmallUnsignedInts(self):
+        # Gateways get unsigned 8 and 16 bit variants as ints, as
+        # DefaultPolicy always gave them.
+        class Bag:
+            _com_interfaces_ = [xpcom.components.interfaces.nsIWritablePropertyBag]
+            def __init__(self):
+                self.props = {}
+            def setProperty(self, name, value):
+                self.props[name] = value
+        ob = Bag()
+        bag = xpcom.server.WrapObject(ob, xpcom.components.interfaces.nsIWritablePropertyBag)
+        for name, value in (("Uint8", 200), ("Uint16", 60000), ("Int16", -2)):
+            v = xpcom.components.classes["@mozilla.org/variant;1"]\
+                     .createInstance(xpcom.components.interfaces.nsIWritableVariant)
+            getattr(v, "setAs" + name)(value)
+            bag.setProperty(name, v)
+            self.failUnlessEqual(ob.props[name], value)
+            self.failUnless(type(ob.props[name]) is int, (name, ob.props[name]))
+
+class TestDispatchTable(unittest.TestCase):
+    def _wrap(self, ob):
+        return xpcom.server.WrapObject(ob, xpcom.components.interfaces.nsISupportsCString)
+
+    def testDispatch(self):
+        class CString:
+            _com_interfaces_ = [xpcom.components.interfaces.nsISupportsCString]
+            _com_dispatch_table_ = True
+            type = xpcom.components.interfaces.nsISupportsPrimitive.TYPE_CSTRING
+            def __init__(self):
+                self.data = "hello"
+            def toString(self):
+                return self.data.upper()
+        ob = CString()
+        wrapped = self._wrap(ob)
+        self.failUnlessEqual(wrapped.data, "hello")
+        wrapped.data = "world"
+        self.failUnlessEqual(ob.data, "world")
+        self.failUnlessEqual(wrapped.toString(), "WORLD")
+        self.failUnlessEqual(wrapped.type, CString.type)
+
+    def testGetSet(self):
+        class CString:
+            _com_interfaces_ = [xpcom.components.interfaces.nsISupportsCString]
+            _com_dispatch_table_ = True
+            def __init__(self):
+                self.value = ""
+            def get_data(self):
+                return self.value
+            def set_data(self, value):
+                self.value = value + "!"
+        ob = CString()
+        wrapped = self._wrap(ob)
+        wrapped.data = "hello"
+        self.failUnlessEqual(ob.value, "hello!")
+        self.failUnlessEqual(wrapped.data, "hello!")
+
+    def testErrors(self):
+        class CString:
+            _com_interfaces_ = [xpcom.components.interfaces.nsISupportsCString]
+            _com_dispatch_table_ = True
+            def toString(self):
+                raise xpcom.ServerException(xpcom.nsError.NS_ERROR_NOT_AVAILABLE)
+        wrapped = self._wrap(CString())
+        try:
+            wrapped.toString()
+            self.fail("Expected a COMException")
+        except xpcom.COMException, details:
+            self.failUnlessEqual(details.errno, xpcom.nsError.NS_ERROR_NOT_AVAILABLE)
+        # 'data' isn't defined at all.
+        self.failUnlessRaises(xpcom.COMException, getattr, wrapped, "data")
+
+class _CStringItem:
+    _com_interfaces_ = [xpcom.components.interfaces.nsISupportsCString]
+    def __init__(self, data):
+        self.data = data
+
+class TestEnumeratorGateway(unittest.TestCase):
+    def _check(self, ob, expected):
+        enum = xpcom.server.WrapObject(ob, xpcom.components.interfaces.nsISimpleEnumerator)
+        got = []
+        while enum.hasMoreElements():
+            item = enum.getNext().QueryInterface(xpcom.components.interfaces.nsISupportsCString)
+            got.append(item.data)
+        self.failUnlessEqual(got, expected)
+        self.failUnlessRaises(xpcom.COMException, enum.getNext)
+
+    def testBlocks(self):
+        # Enough elements for a few of the gateway's blocks.
+        from xpcom.server.enumerator import SimpleEnumerator
+        expected = [str(i) for i in range(1200)]
+        self._check(SimpleEnumerator([_CStringItem(d) for d in expected]), expected)
+        self._check(SimpleEnumerator([]), [])
+
+    def testNoFetchBlock(self):
+        class Enum:
+            _com_interfaces_ = [xpcom.components.interfaces.nsISimpleEnumerator]
+            def __init__(self, data):
+                self.data = data
+            def hasMoreElements(self):
+                return len(self.data) != 0
+            def getNext(self):
+                if not self.data:
+                    raise xpcom.ServerException(xpcom.nsError.NS_ERROR_FAILURE)
+                return self.data.pop(0)
+        expected = ["a", "b", "c"]
+        self._check(Enum([_CStringItem(d) for d in expected]), expected)
+
+    def testOtherInterfaces(self):
+        # The enumerator gateway is the base object here, so the stub for
+        # the other interface must be kept by it.
+        from xpcom.server.enumerator import SimpleEnumerator
+        class ObservedEnum(SimpleEnumerator):
+            _com_interfaces_ = [xpcom.components.interfaces.nsISimpleEnumerator,
+                                xpcom.components.interfaces.nsIObserver]
+            def observe(self, subject, topic, data):
+                self.topic = topic
+        ob = ObservedEnum([_CStringItem("a")])
+        enum = xpcom.server.WrapObject(ob, xpcom.components.interfaces.nsISimpleEnumerator)
+        observer = enum._comobj_.QueryInterface(xpcom.components.interfaces.nsIObserver, 0)
+        for i in range(3):
+            again = enum._comobj_.QueryInterface(xpcom.components.interfaces.nsIObserver, 0)
+            self.failUnlessEqual(again, observer)
+        observer.observe(None, "topic", None)
+        self.failUnlessEqual(ob.topic, "topic")
+        # And the stub leads back to the enumerator.
+        enum2 = observer.QueryInterface(xpcom.components.interfaces.nsISimpleEnumerator)
+        self.failUnless(enum2.hasMoreElements())
+        del observer, again
+        # A new stub for the interface once the first has gone.
+        observer = enum._comobj_.QueryInterface(xpcom.components.interfaces.nsIObserver, 0)
+        observer.observe(None, "again", None)
+        self.failUnlessEqual(ob.topic, "again")
+
 if __name__=='__main__':
     testmain()
@@ -71,12 +71,18 @@ class koTestSimpleStream:
     def isNonBlocking(self):
         return self._non_blocking
 
-def get_test_input():
+class koTestSegmentedStream(koTestSimpleStream):
+    # Hands its data to ReadSegments() as a number of separate buffers.
+    def readSegments(self, amount):
+        data = self.data.read(amount)
+        return [data[i:i+4] for i in range(0, len(data), 4)]
+
+def get_test_input(klass = koTestSimpleStream):
     # We use a couple of internal hacks here that mean we can avoid having the object
     # registered.  This code means that we are still working over the xpcom boundaries, tho
     # (and the point of this test is not the registration, etc).
     import xpcom.server, xpcom.client
-    ob = xpcom.server.WrapObject( koTestSimpleStream(), _xpcom.IID_nsISupports)
+    ob = xpcom.server.WrapObject( klass(), _xpcom.IID_nsISupports)
     ob = xpcom.client.Component(ob._comobj_, components.interfaces.nsIInputStream)
     return ob
 
@@ -92,5 +98,39 @@ class StreamTests(unittest.TestCase):
         self.failIf(myStream.isNonBlocking(), "Expected default to be blocking")
         # stream observer mechanism has changed - we should test that.
 
+    def testReadInto(self):
+        myStream = get_test_input()
+        buf = bytearray(5)
+        self.failUnlessEqual(myStream.readinto(buf), 5)
+        self.failUnlessEqual(str(buf), test_data[:5])
+        # An explicit size smaller than the buffer
+        buf = bytearray(10)
+        self.failUnlessEqual(myStream.readinto(buf, 3), 3)
+        self.failUnlessEqual(str(buf[:3]), test_data[5:8])
+        # A short read only fills part of the buffer.
+        buf = bytearray(100)
+        nread = myStream.readinto(buf)
+        self.failUnlessEqual(nread, len(test_data) - 8)
+        self.failUnlessEqual(str(buf[:nread]), test_data[8:])
+        self.failUnlessRaises(TypeError, myStream.readinto, "not writable")
+
+    def do_test_read_segments(self, myStream):
+        # The converter stream fills its buffer via ReadSegments()
+        cis = components.classes["@mozilla.org/intl/converter-input-stream;1"]\
+                        .createInstance(components.interfaces.nsIConverterInputStream)
+        cis.init(myStream, "UTF-8", 0, 0)
+        self.failUnlessEqual(cis.readString(100), (len(test_data), test_data))
+
+    def testReadSegments(self):
+        self.do_test_read_segments(get_test_input())
+
+    def testReadSegmentsMultiple(self):
+        self.do_test_read_segments(get_test_input(koTestSegmentedStream))
+
+    def testShortRead(self):
+        myStream = get_test_input()
+        # Asking for more than is there gives back just what was read.
+        self.failUnlessEqual(str(myStream.read(100)), test_data)
+
 if __name__=='__main__':
     testmain()
@@ -36,6 +36,7 @@
 # ***** END LICENSE BLOCK *****
 
 import sys, os, time, traceback
+import array
 import xpcom.components
 import xpcom._xpcom
 import xpcom.nsError
@@ -377,6 +378,10 @@ def test_derived_interface(c, test_flat = 0, isJS = False):
         test_method(c.DoubleWideString4, (val,), expected, expected_type=unicode)
     test_method(c.UpWideString, (val,), val.upper(), expected_type=unicode)
     test_method(c.UpWideString2, (val,), val.upper(), expected_type=unicode)
+    # Characters outside the BMP are passed as surrogate pairs.
+    val = u"G clef \U0001d11e"
+    test_method(c.DoubleWideString, (val,), val * 2, expected_type=unicode)
+    test_method(c.UpWideString, (val,), val.upper(), expected_type=unicode)
     test_method(c.GetFixedWideString, (20,), u"A"*20, expected_type=unicode)
     val = extended_unicode_string
     test_method(c.CopyUTF8String, ("foo",), u"foo", expected_type=unicode)
@@ -432,6 +437,27 @@ def test_derived_interface(c, test_flat = 0, isJS = False):
     test_method(c.GetArrays, (), ( [1,2,3], [4,5,6] ) )
     test_method(c.CopyArray, ([1,2,3],), [1,2,3] )
     test_method(c.CopyAndDoubleArray, ([1,2,3],), [1,2,3,1,2,3] )
+    # Numeric arrays can also come from objects with a buffer.
+    test_method(c.CopyArray, (array.array('i', [1,2,3]),), [1,2,3] )
+    test_method(c.CopyArray, (array.array('h', [1,-2,3]),), [1,-2,3] )
+    test_method(c.CopyArray, (array.array('d', [1.0,2.0,3.0]),), [1,2,3] )
+    test_method(c.CopyArray, (bytearray("\x01\x02\x03"),), [1,2,3] )
+    # Floats which don't fit the array type are rejected, as for sequences.
+    try:
+        c.CopyArray(array.array('d', [1.0, float("nan")]))
+        print_error("CopyArray accepted a NaN in an int array")
+    except ValueError:
+        pass
+    # And numeric array results can be returned without unpacking.
+    old = xpcom._xpcom.SetBufferArrayResults(True)
+    try:
+        ret = c.CopyArray([1,2,3])
+        if list(ret) != [1,2,3] or array.array('i', str(buffer(ret))).tolist() != [1,2,3]:
+            print_error("Array result %r doesn't hold [1,2,3]" % (ret,))
+        if memoryview(ret).format != 'i' or len(ret) != 3:
+            print_error("Array result %r has the wrong format" % (ret,))
+    finally:
+        xpcom._xpcom.SetBufferArrayResults(old)
     # for the next call, the second arg (None) is automatically converted to an array [0,0,0]
     # because we can't pass null to inout args
     test_method(c.AppendArray, ([1,2,3],), [1,2,3,0,0,0])
@@ -439,12 +465,15 @@ def test_derived_interface(c, test_flat = 0, isJS = False):
 
     test_method(c.CopyVariant, ([],), [])
     test_method(c.CopyVariant, (None,), None)
+    test_method(c.CopyVariant, (True,), True)
+    test_method(c.CopyVariant, (False,), False)
     test_method(c.CopyVariant, (1,), 1)
     test_method(c.CopyVariant, (1.0,), 1.0)
     test_method(c.CopyVariant, (-1,), -1)
     test_method(c.CopyVariant, ((1 << 31) - 1,), (1 << 31) - 1)
     test_method(c.CopyVariant, ("foo",), "foo")
     test_method(c.CopyVariant, (u"foo",), u"foo")
+    test_method(c.CopyVariant, (u"\U00010000 astral",), u"\U00010000 astral")
     test_method(c.CopyVariant, (c,), c)
     test_method(c.CopyVariant, (component_iid,), component_iid)
     test_method(c.CopyVariant, ((1,2),), [1,2])
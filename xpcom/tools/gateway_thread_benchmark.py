@@ -0,0 +1,68 @@
+#!/usr/bin/env python2
+
+# Stress gateway AddRef/Release/QueryInterface from many XPCOM threads at
+# once.  Each thread works on its own gateways, so they should only contend
+# in the native code if unrelated gateways share a lock.  The AddRef and
+# Release come from storing the gateway in an nsISupportsInterfacePointer,
+# and the QI is of the raw interface; both happen with the Python
+# thread-lock released.
+# Usage:
+#   $0 [iterations [max_threads]]
+
+import sys
+import time
+
+from xpcom import components
+import xpcom.server
+
+class Target:
+    _com_interfaces_ = [components.interfaces.nsIObserver,
+                        components.interfaces.nsIRunnable]
+    def observe(self, subject, topic, data):
+        pass
+    def run(self):
+        pass
+
+class Worker:
+    _com_interfaces_ = [components.interfaces.nsIRunnable]
+    def __init__(self, iterations):
+        self.iterations = iterations
+    def run(self):
+        ob = xpcom.server.WrapObject(Target(), components.interfaces.nsIObserver)._comobj_
+        holder = components.classes["@mozilla.org/supports-interface-pointer;1"]\
+                           .createInstance(components.interfaces.nsISupportsInterfacePointer)
+        iid = components.interfaces.nsIRunnable
+        # The first QI creates the stub via Python.
+        ob.QueryInterface(iid, 0)
+        for i in xrange(self.iterations):
+            holder.data = ob
+            holder.data = None
+            ob.QueryInterface(iid, 0)
+
+def run_threads(num_threads, iterations):
+    tm = components.classes["@mozilla.org/thread-manager;1"]\
+                   .getService(components.interfaces.nsIThreadManager)
+    threads = [tm.newThread(0) for i in range(num_threads)]
+    start = time.time()
+    for thread in threads:
+        thread.dispatch(Worker(iterations),
+                        components.interfaces.nsIEventTarget.DISPATCH_NORMAL)
+    # Shutting a thread down waits for its events while still processing
+    # the main thread's.
+    for thread in threads:
+        thread.shutdown()
+    return time.time() - start
+
+def main():
+    iterations = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+    max_threads = int(sys.argv[2]) if len(sys.argv) > 2 else 32
+    num_threads = 1
+    while num_threads <= max_threads:
+        elapsed = run_threads(num_threads, iterations)
+        count = num_threads * iterations
+        print "%2d threads: %d AddRef/Release/QI rounds in %.3fs (%.0f rounds/s)" % (
+            num_threads, count, elapsed, count / elapsed)
+        num_threads *= 2
+
+if __name__ == '__main__':
+    main()
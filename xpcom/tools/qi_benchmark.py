@@ -0,0 +1,75 @@
+#!/usr/bin/env python2
+
+# Measure QueryInterface throughput on a Python object implementing many
+# interfaces.  Once each interface has been QI'd for the first time, every
+# further QI is answered by the gateway's IID->stub table.  We QI the raw
+# interface, as xpcom.client Components remember the interfaces they have
+# already been QI'd for and never reach the gateway.  With more than one
+# thread, each XPCOM thread QIs the same object, so they all read the one
+# stub table at once.
+# Usage:
+#   $0 [iterations [threads]]
+
+import sys
+import time
+
+from xpcom import components
+import xpcom.server
+
+interface_names = [
+    "nsIObserver", "nsIRunnable", "nsITimerCallback", "nsIRequestObserver",
+    "nsIStreamListener", "nsIInputStreamCallback", "nsIOutputStreamCallback",
+    "nsISupportsCString", "nsISupportsString", "nsISupportsPRBool",
+    "nsISupportsPRUint8", "nsISupportsPRUint16", "nsISupportsPRUint32",
+    "nsISupportsPRUint64", "nsISupportsPRInt16", "nsISupportsPRInt32",
+    "nsISupportsPRInt64", "nsISupportsFloat", "nsISupportsDouble",
+    "nsISupportsChar", "nsISupportsVoid", "nsISupportsInterfacePointer",
+    "nsISupportsID", "nsIFactory",
+]
+
+class ManyInterfaces:
+    _com_interfaces_ = [getattr(components.interfaces, name)
+                        for name in interface_names
+                        if components.interfaces.has_key(name)]
+
+class Worker:
+    _com_interfaces_ = [components.interfaces.nsIRunnable]
+    def __init__(self, ob, iids, iterations):
+        self.ob = ob
+        self.iids = iids
+        self.iterations = iterations
+    def run(self):
+        ob = self.ob
+        iids = self.iids
+        for i in xrange(self.iterations):
+            for iid in iids:
+                ob.QueryInterface(iid, 0)
+
+def main():
+    iterations = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+    num_threads = int(sys.argv[2]) if len(sys.argv) > 2 else 1
+    iids = ManyInterfaces._com_interfaces_
+    ob = xpcom.server.WrapObject(ManyInterfaces(), iids[0])._comobj_
+    # The first QI for each interface creates its stub via Python.
+    for iid in iids:
+        ob.QueryInterface(iid, 0)
+    if num_threads == 1:
+        start = time.time()
+        Worker(ob, iids, iterations).run()
+    else:
+        tm = components.classes["@mozilla.org/thread-manager;1"]\
+                       .getService(components.interfaces.nsIThreadManager)
+        threads = [tm.newThread(0) for i in range(num_threads)]
+        start = time.time()
+        for thread in threads:
+            thread.dispatch(Worker(ob, iids, iterations),
+                            components.interfaces.nsIEventTarget.DISPATCH_NORMAL)
+        for thread in threads:
+            thread.shutdown()
+    elapsed = time.time() - start
+    count = iterations * len(iids) * num_threads
+    print "%d interfaces, %d threads, %d QIs in %.3fs (%.0f QI/s)" % (
+        len(iids), num_threads, count, elapsed, count / elapsed)
+
+if __name__ == '__main__':
+    main()